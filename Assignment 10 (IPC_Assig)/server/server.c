@@ -1,151 +1,448 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <pthread.h>
-
-#define PORT 8080
-#define DB_FILE "../resource/accountDB.txt"
-
-pthread_mutex_t file_mutex;
-
-double getBalance();
-void updateBalance(double new_balance);
-void *handleClient(void *socket_desc);
-
-int main()
-{
-    int server_fd, new_socket, *new_sock;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-
-    pthread_mutex_init(&file_mutex, NULL);
-
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0)
-    {
-        perror("Socket failed");
-        exit(EXIT_FAILURE);
-    }
-
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
-    {
-        perror("Bind failed");
-        exit(EXIT_FAILURE);
-    }
-    if (listen(server_fd, 3) < 0)
-    {
-        perror("Listen failed");
-        exit(EXIT_FAILURE);
-    }
-
-    printf("ATM Server listening on port %d...\n", PORT);
-
-    while (1)
-    {
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0)
-        {
-            perror("Accept failed");
-            continue;
-        }
-
-        printf("New client connected.\n");
-
-        pthread_t thread_id;
-        new_sock = malloc(1);
-        *new_sock = new_socket;
-
-        if (pthread_create(&thread_id, NULL, handleClient, (void *)new_sock) < 0)
-        {
-            perror("Could not create thread");
-            return 1;
-        }
-        pthread_detach(thread_id);
-    }
-
-    pthread_mutex_destroy(&file_mutex);
-    return 0;
-}
-
-double getBalance()
-{
-    FILE *file = fopen(DB_FILE, "r");
-    double balance;
-    fscanf(file, "%lf", &balance);
-    fclose(file);
-    return balance;
-}
-
-void updateBalance(double new_balance)
-{
-    FILE *file = fopen(DB_FILE, "w");
-    if (file)
-    {
-        fprintf(file, "%.2lf", new_balance);
-        fclose(file);
-    }
-}
-
-void *handleClient(void *socket_desc)
-{
-    int sock = *(int *)socket_desc;
-    free(socket_desc);
-    char buffer[1024] = {0};
-    int choice;
-    double amount;
-
-    while (1)
-    {
-        int valread = read(sock, buffer, 1024);
-        if (valread <= 0)
-        {
-            break;
-        }
-
-        sscanf(buffer, "%d %lf", &choice, &amount);
-        char response[1024];
-
-        pthread_mutex_lock(&file_mutex);
-
-        double current_balance = getBalance();
-
-        if (choice == 1)
-        {
-            if (amount > current_balance)
-            {
-                snprintf(response, sizeof(response), "Error: Insufficient funds. Balance: %.2lf", current_balance);
-            }
-            else
-            {
-                current_balance -= amount;
-                updateBalance(current_balance);
-                snprintf(response, sizeof(response), "Withdrawal successful. New Balance: %.2lf", current_balance);
-            }
-        }
-        else if (choice == 2)
-        {
-            current_balance += amount;
-            updateBalance(current_balance);
-            snprintf(response, sizeof(response), "Deposit successful. New Balance: %.2lf", current_balance);
-        }
-        else if (choice == 3)
-        {
-            snprintf(response, sizeof(response), "Current Balance: %.2lf", current_balance);
-        }
-        else
-        {
-            strcpy(response, "Invalid option");
-        }
-
-        pthread_mutex_unlock(&file_mutex);
-
-        send(sock, response, strlen(response), 0);
-    }
-
-    close(sock);
-    return NULL;
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+#define PORT 8080
+#define DB_DIR "../resource"
+#define DB_FILE "../resource/accountDB.txt"
+#define SNAPSHOT_TMP "../resource/accountDB.txt.tmp"
+#define WAL_FILE "../resource/accountDB.wal"
+#define WAL_BUF_SIZE 65536
+#define WAL_RECORD_MAX 64
+#define BALANCE_LIMIT 1e13
+
+typedef enum
+{
+    FSYNC_NONE,
+    FSYNC_GROUP,
+    FSYNC_ALWAYS
+} FsyncMode;
+
+/*
+ * The balance lives in memory. Every change is appended to the WAL as
+ * "lsn balance" and the client is answered only once that record is durable.
+ * In group mode the first waiting thread writes and fsyncs everything queued
+ * so far on behalf of the others. Every snapshot_every records the balance is
+ * written to DB_FILE with its LSN and the WAL is truncated; on startup the
+ * snapshot is loaded and newer WAL records are replayed.
+ */
+pthread_mutex_t account_mutex;
+pthread_cond_t durable_cond;
+
+double balance = 0;
+double logged_balance = 0;
+long long next_lsn = 1;
+long long durable_lsn = 0;
+long long snapshot_lsn = 0;
+
+char wal_buf[WAL_BUF_SIZE];
+char flush_buf[WAL_BUF_SIZE];
+size_t wal_len = 0;
+int wal_fd = -1;
+int flushing = 0;
+
+FsyncMode fsync_mode = FSYNC_GROUP;
+int group_commit_us = 0;
+long long snapshot_every = 10000;
+
+int parseOptions(int argc, char **argv);
+int loadAccount();
+double roundCents(double value);
+void writeAll(int fd, const char *data, size_t len);
+void syncWal();
+void syncDbDir();
+void logBalance(double new_balance);
+void waitDurable(long long lsn);
+int writeSnapshot(double snap_balance, long long lsn);
+void *handleClient(void *socket_desc);
+
+int main(int argc, char **argv)
+{
+    int server_fd, new_socket, *new_sock;
+    struct sockaddr_in address;
+    int addrlen = sizeof(address);
+
+    if (!parseOptions(argc, argv) || !loadAccount())
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&account_mutex, NULL);
+    pthread_cond_init(&durable_cond, NULL);
+
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0)
+    {
+        perror("Socket failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(PORT);
+
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(server_fd, 3) < 0)
+    {
+        perror("Listen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("ATM Server listening on port %d...\n", PORT);
+
+    while (1)
+    {
+        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0)
+        {
+            perror("Accept failed");
+            continue;
+        }
+
+        printf("New client connected.\n");
+
+        pthread_t thread_id;
+        new_sock = malloc(sizeof(int));
+        *new_sock = new_socket;
+
+        if (pthread_create(&thread_id, NULL, handleClient, (void *)new_sock) < 0)
+        {
+            perror("Could not create thread");
+            return 1;
+        }
+        pthread_detach(thread_id);
+    }
+
+    pthread_cond_destroy(&durable_cond);
+    pthread_mutex_destroy(&account_mutex);
+    return 0;
+}
+
+int parseOptions(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+        if (strcmp(option, "fsync=always") == 0)
+        {
+            fsync_mode = FSYNC_ALWAYS;
+        }
+        else if (strcmp(option, "fsync=group") == 0)
+        {
+            fsync_mode = FSYNC_GROUP;
+        }
+        else if (strcmp(option, "fsync=none") == 0)
+        {
+            fsync_mode = FSYNC_NONE;
+        }
+        else if (strncmp(option, "group_commit_us=", 16) == 0 && atoi(option + 16) >= 0)
+        {
+            group_commit_us = atoi(option + 16);
+        }
+        else if (strncmp(option, "snapshot_every=", 15) == 0 && atoll(option + 15) > 0)
+        {
+            snapshot_every = atoll(option + 15);
+        }
+        else
+        {
+            printf("Invalid option %s\n", option);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* A record cut short by a crash ends the log; it was never acknowledged. */
+int loadAccount()
+{
+    FILE *file = fopen(DB_FILE, "r");
+    if (file)
+    {
+        if (fscanf(file, "%lf %lld", &balance, &snapshot_lsn) < 1)
+        {
+            balance = 0;
+        }
+        fclose(file);
+    }
+
+    file = fopen(WAL_FILE, "r");
+    long good = 0;
+    durable_lsn = snapshot_lsn;
+    if (file)
+    {
+        char line[WAL_RECORD_MAX];
+        long long lsn;
+        double value;
+        while (fgets(line, sizeof(line), file) && strchr(line, '\n') &&
+               sscanf(line, "%lld %lf", &lsn, &value) == 2)
+        {
+            if (lsn > durable_lsn)
+            {
+                balance = value;
+                durable_lsn = lsn;
+            }
+            good = ftell(file);
+        }
+        fclose(file);
+    }
+    next_lsn = durable_lsn + 1;
+    logged_balance = balance;
+
+    wal_fd = open(WAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (wal_fd < 0 || ftruncate(wal_fd, good) < 0)
+    {
+        perror("Cannot open WAL");
+        return 0;
+    }
+    syncDbDir();
+
+    printf("Recovered balance %.2lf at log position %lld\n", balance, durable_lsn);
+    return 1;
+}
+
+/*
+ * The balance used to be re-read from a "%.2lf" file on every request.
+ * Callers keep |value| within BALANCE_LIMIT so the cents fit a long long.
+ */
+double roundCents(double value)
+{
+    return (double)(long long)(value * 100 + (value < 0 ? -0.5 : 0.5)) / 100;
+}
+
+void writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            perror("WAL write failed");
+            exit(EXIT_FAILURE);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void syncWal()
+{
+    if (fsync_mode != FSYNC_NONE && fdatasync(wal_fd) < 0)
+    {
+        perror("WAL fsync failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* A new WAL file or renamed snapshot survives a crash only once DB_DIR is synced. */
+void syncDbDir()
+{
+    int dir = open(DB_DIR, O_RDONLY);
+    if (dir >= 0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+}
+
+/*
+ * Called with account_mutex held. durable_lsn only moves when a flush has
+ * written records, so while wal_len is non-zero it is below next_lsn - 1 and
+ * waiting for next_lsn - 1 always drains the buffer.
+ */
+void logBalance(double new_balance)
+{
+    while (fsync_mode != FSYNC_ALWAYS && wal_len + WAL_RECORD_MAX > WAL_BUF_SIZE)
+    {
+        waitDurable(next_lsn - 1);
+    }
+
+    long long lsn = next_lsn++;
+    logged_balance = new_balance;
+    char *record = fsync_mode == FSYNC_ALWAYS ? flush_buf : wal_buf + wal_len;
+    int len = snprintf(record, WAL_RECORD_MAX, "%lld %.2lf\n", lsn, new_balance);
+
+    if (fsync_mode != FSYNC_ALWAYS)
+    {
+        wal_len += len;
+        return;
+    }
+
+    writeAll(wal_fd, record, len);
+    syncWal();
+    durable_lsn = lsn;
+    if (lsn - snapshot_lsn >= snapshot_every && writeSnapshot(new_balance, lsn))
+    {
+        snapshot_lsn = lsn;
+    }
+}
+
+/* Called with account_mutex held. */
+void waitDurable(long long lsn)
+{
+    while (durable_lsn < lsn)
+    {
+        if (flushing)
+        {
+            pthread_cond_wait(&durable_cond, &account_mutex);
+            continue;
+        }
+
+        flushing = 1;
+        if (group_commit_us > 0)
+        {
+            pthread_mutex_unlock(&account_mutex);
+            usleep(group_commit_us);
+            pthread_mutex_lock(&account_mutex);
+        }
+
+        size_t len = wal_len;
+        long long upto = next_lsn - 1;
+        double upto_balance = logged_balance;
+        memcpy(flush_buf, wal_buf, len);
+        wal_len = 0;
+
+        pthread_mutex_unlock(&account_mutex);
+        writeAll(wal_fd, flush_buf, len);
+        syncWal();
+        pthread_mutex_lock(&account_mutex);
+
+        if (upto > durable_lsn)
+        {
+            durable_lsn = upto;
+        }
+        if (upto - snapshot_lsn >= snapshot_every)
+        {
+            pthread_mutex_unlock(&account_mutex);
+            int saved = writeSnapshot(upto_balance, upto);
+            pthread_mutex_lock(&account_mutex);
+
+            if (saved)
+            {
+                snapshot_lsn = upto;
+            }
+        }
+
+        flushing = 0;
+        pthread_cond_broadcast(&durable_cond);
+    }
+}
+
+/*
+ * Snapshots a balance whose records up to lsn are already on disk. DB_FILE is
+ * replaced atomically before the WAL is cut, so a crash at any point leaves
+ * either the old snapshot with the full log or the new one. Other threads may
+ * keep appending to wal_buf meanwhile; those records are newer than lsn and
+ * reach the WAL file only after the truncate, through the next flush. Only the
+ * thread that owns the WAL file (the flusher, or the caller under
+ * account_mutex in always mode) calls this. Returns 0 if the snapshot was not
+ * written, in which case the WAL still holds everything.
+ */
+int writeSnapshot(double snap_balance, long long lsn)
+{
+    FILE *file = fopen(SNAPSHOT_TMP, "w");
+    if (!file)
+    {
+        perror("Snapshot failed");
+        return 0;
+    }
+    fprintf(file, "%.2lf %lld\n", snap_balance, lsn);
+    if (fflush(file) != 0 || fsync(fileno(file)) < 0)
+    {
+        perror("Snapshot failed");
+        fclose(file);
+        return 0;
+    }
+    if (fclose(file) != 0 || rename(SNAPSHOT_TMP, DB_FILE) < 0)
+    {
+        perror("Snapshot failed");
+        return 0;
+    }
+    syncDbDir();
+
+    if (ftruncate(wal_fd, 0) < 0)
+    {
+        perror("WAL truncate failed");
+    }
+    return 1;
+}
+
+void *handleClient(void *socket_desc)
+{
+    int sock = *(int *)socket_desc;
+    free(socket_desc);
+    char buffer[1024] = {0};
+    int choice;
+    double amount;
+
+    while (1)
+    {
+        int valread = read(sock, buffer, sizeof(buffer) - 1);
+        if (valread <= 0)
+        {
+            break;
+        }
+        buffer[valread] = '\0';
+
+        sscanf(buffer, "%d %lf", &choice, &amount);
+        char response[1024];
+
+        pthread_mutex_lock(&account_mutex);
+
+        double current_balance = balance;
+
+        if ((choice == 1 || choice == 2) &&
+            (!isfinite(amount) || fabs(amount) > BALANCE_LIMIT ||
+             fabs(current_balance + (choice == 1 ? -amount : amount)) > BALANCE_LIMIT))
+        {
+            snprintf(response, sizeof(response), "Error: Invalid amount. Balance: %.2lf", current_balance);
+        }
+        else if (choice == 1)
+        {
+            if (amount > current_balance)
+            {
+                snprintf(response, sizeof(response), "Error: Insufficient funds. Balance: %.2lf", current_balance);
+            }
+            else
+            {
+                current_balance = roundCents(current_balance - amount);
+                balance = current_balance;
+                logBalance(current_balance);
+                snprintf(response, sizeof(response), "Withdrawal successful. New Balance: %.2lf", current_balance);
+            }
+        }
+        else if (choice == 2)
+        {
+            current_balance = roundCents(current_balance + amount);
+            balance = current_balance;
+            logBalance(current_balance);
+            snprintf(response, sizeof(response), "Deposit successful. New Balance: %.2lf", current_balance);
+        }
+        else if (choice == 3)
+        {
+            snprintf(response, sizeof(response), "Current Balance: %.2lf", current_balance);
+        }
+        else
+        {
+            strcpy(response, "Invalid option");
+        }
+
+        /* Never report a balance that a crash could still take back. */
+        waitDurable(next_lsn - 1);
+        pthread_mutex_unlock(&account_mutex);
+
+        send(sock, response, strlen(response), 0);
+    }
+
+    close(sock);
+    return NULL;
+}
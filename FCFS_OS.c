@@ -1,539 +1,3483 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-
-#define HASH_MAP_SIZE 1009
-#define MAX_NAME_LEN 64
-#define MAX_PROCS 1000
-#define MAX_EVENTS 1000
-
-typedef enum
-{
-    READY,
-    RUNNING,
-    WAITING,
-    TERMINATED
-} State;
-
-typedef struct PCB
-{
-    char name[MAX_NAME_LEN];
-    int pid;
-
-    int cpu_burst;
-    int cpu_remaining;
-
-    int io_start;
-    int io_duration;
-    int io_remaining;
-
-    int executed_time;
-    int completion_time;
-    int io_time_total;
-
-    int killed;
-    int killed_time;
-
-    State state;
-    struct PCB *next;
-} PCB;
-
-typedef struct Queue
-{
-    PCB *front;
-    PCB *rear;
-} Queue;
-
-typedef struct HashMapNode
-{
-    int key;
-    PCB *process;
-    struct HashMapNode *next;
-} HashMapNode;
-
-typedef struct KillEvent
-{
-    int pid;
-    int time;
-} KillEvent;
-
-int hashFunction(int key);
-void hashPut(int key, PCB *process);
-PCB *hashGet(int key);
-
-void initQueue(Queue *q);
-void enqueue(Queue *q, PCB *p);
-PCB *dequeue(Queue *q);
-PCB *removeFromQueue(Queue *q, int pid);
-void forEachQueue(Queue *q, void (*fn)(PCB *, void *), void *ctx);
-
-PCB *createPCB(const char *name, int pid, int burst, int io_start, int io_dur);
-void trim(char *s); 
-void parseLine(char *line);
-void decIO(PCB *p, void *ctx);
-void checkIOCompletion();
-void terminatePCB(PCB *p, int time);
-void applyKillEvents(int time, PCB **running, int *terminated);
-void simulate();
-int cmpPID(const void *a, const void *b);
-void printResults();
-
-HashMapNode *hashMap[HASH_MAP_SIZE];
-Queue readyQ, waitingQ, terminatedQ;
-PCB *procList[MAX_PROCS];
-KillEvent killList[MAX_EVENTS];
-
-int procCount = 0;
-int killCount = 0;
-int totalProcesses = 0;
-
-int main()
-{
-    initQueue(&readyQ);
-    initQueue(&waitingQ);
-    initQueue(&terminatedQ);
-
-    char line[256];
-
-    while (fgets(line, sizeof(line), stdin))
-    {
-        parseLine(line);
-    }
-
-    if (totalProcesses == 0)
-    {
-        printf("No processes entered.\n");
-        return 0;
-    }
-
-    simulate();
-    printResults();
-    return 0;
-}
-
-void trim(char *s)
-{
-    int i = 0, j = 0;
-
-    while (isspace(s[i]))
-    {
-        i++;
-    }
-
-    while (s[i])
-    {
-        s[j++] = s[i++];
-    }
-
-    s[j] = '\0';
-
-    while (j > 0 && isspace(s[j - 1]))
-    {
-        s[--j] = '\0';
-    }
-}
-
-void parseLine(char *line)
-{
-    trim(line);
-    if (strlen(line) == 0)
-    {
-        return;
-    }
-
-    char first[16];
-    sscanf(line, "%s", first);
-
-    if (strcasecmp(first, "KILL") == 0) 
-    {
-        int pid, time_val;
-        sscanf(line + strlen(first), "%d %d", &pid, &time_val);
-        killList[killCount].pid = pid;
-        killList[killCount].time = time_val;
-        killCount++;
-        return;
-    }
-
-    char name[MAX_NAME_LEN];
-    char io1[16], io2[16];
-    int pid, burst;
-
-    int n = sscanf(line, "%s %d %d %s %s", name, &pid, &burst, io1, io2);
-
-    if (n < 3)
-    {
-        return;
-    }
-
-    if (hashGet(pid))
-    {
-        return;
-    }
-
-    int io_start = -1, io_dur = 0;
-
-    if (n == 5)
-    {
-        if (strcmp(io1, "-") != 0)
-        {
-            io_start = atoi(io1);
-        }
-        if (strcmp(io2, "-") != 0)
-        {
-            io_dur = atoi(io2);
-        }
-    }
-
-    PCB *p = createPCB(name, pid, burst, io_start, io_dur);
-    if (!p)
-    {
-        return;
-    }
-
-    procList[procCount++] = p;
-    totalProcesses++;
-    hashPut(pid, p);
-    enqueue(&readyQ, p);
-}
-
-int hashFunction(int key)
-{
-    int h = key % HASH_MAP_SIZE;
-    return (h < 0 ? h + HASH_MAP_SIZE : h);
-}
-
-void hashPut(int key, PCB *process)
-{
-    int idx = hashFunction(key);
-    HashMapNode *cur = hashMap[idx];
-
-    while (cur)
-    {
-        if (cur->key == key)
-        {
-            return;
-        }
-        cur = cur->next;
-    }
-
-    HashMapNode *node = (HashMapNode *)malloc(sizeof(HashMapNode));
-    node->key = key;
-    node->process = process;
-    node->next = hashMap[idx];
-    hashMap[idx] = node;
-}
-
-PCB *hashGet(int key)
-{
-    int idx = hashFunction(key);
-    HashMapNode *cur = hashMap[idx];
-    while (cur)
-    {
-        if (cur->key == key)
-        {
-            return cur->process;
-        }
-        cur = cur->next;
-    }
-    return NULL;
-}
-
-void initQueue(Queue *q)
-{
-    q->front = q->rear = NULL;
-}
-
-void enqueue(Queue *q, PCB *p)
-{
-    p->next = NULL;
-    if (q->rear)
-    {
-        q->rear->next = p;
-        q->rear = p;
-    }
-    else
-    {
-        q->front = q->rear = p;
-    }
-}
-
-PCB *dequeue(Queue *q)
-{
-    if (!q->front)
-    {
-        return NULL;
-    }
-    PCB *p = q->front;
-    q->front = p->next;
-    if (!q->front)
-    {
-        q->rear = NULL;
-    }
-    return p;
-}
-
-PCB *removeFromQueue(Queue *q, int pid)
-{
-    PCB *cur = q->front;
-    PCB *prev = NULL;
-    while (cur)
-    {
-        if (cur->pid == pid)
-        {
-            if (prev)
-            {
-                prev->next = cur->next;
-            }
-            else
-            {
-                q->front = cur->next;
-            }
-            if (cur == q->rear)
-            {
-                q->rear = prev;
-            }
-            cur->next = NULL;
-            return cur;
-        }
-        prev = cur;
-        cur = cur->next;
-    }
-    return NULL;
-}
-
-void forEachQueue(Queue *q, void (*fn)(PCB *, void *), void *ctx)
-{
-    PCB *cur = q->front;
-    while (cur)
-    {
-        PCB *nxt = cur->next;
-        fn(cur, ctx);
-        cur = nxt;
-    }
-}
-
-PCB *createPCB(const char *name, int pid, int burst, int io_start, int io_dur)
-{
-    if (burst < 0 || io_dur < 0)
-    {
-        return NULL;
-    }
-
-    PCB *p = (PCB *)malloc(sizeof(PCB));
-    strcpy(p->name, name);
-
-    p->pid = pid;
-    p->cpu_burst = burst;
-    p->cpu_remaining = burst;
-
-    p->io_start = io_start;
-    p->io_duration = io_dur;
-    p->io_remaining = 0;
-    p->io_time_total = io_dur;
-
-    p->executed_time = 0;
-    p->completion_time = -1;
-    p->killed = 0;
-    p->killed_time = -1;
-    p->state = READY;
-    p->next = NULL;
-
-    return p;
-}
-
-void decIO(PCB *p, void *ctx)
-{
-    if (p->io_remaining > 0)
-    {
-        p->io_remaining--;
-    }
-}
-
-void checkIOCompletion()
-{
-    PCB *prev = NULL;
-    PCB *cur = waitingQ.front;
-
-    while (cur)
-    {
-        PCB *nxt = cur->next;
-        if (cur->io_remaining == 0)
-        {
-            if (prev)
-            {
-                prev->next = cur->next;
-            }
-            else
-            {
-                waitingQ.front = cur->next;
-            }
-            if (cur == waitingQ.rear)
-            {
-                waitingQ.rear = prev;
-            }
-            cur->state = READY;
-            enqueue(&readyQ, cur);
-        }
-        else
-        {
-            prev = cur;
-        }
-        cur = nxt;
-    }
-}
-
-void terminatePCB(PCB *p, int time)
-{
-    p->state = TERMINATED;
-    p->completion_time = time;
-    enqueue(&terminatedQ, p);
-}
-
-void applyKillEvents(int time, PCB **running, int *terminated)
-{
-    for (int i = 0; i < killCount; i++)
-    {
-        if (killList[i].time == time)
-        {
-            int pid = killList[i].pid;
-            PCB *target = hashGet(pid);
-            if (!target || target->state == TERMINATED)
-            {
-                continue;
-            }
-
-            if (*running && (*running)->pid == pid)
-            {
-                PCB *p = *running;
-                *running = NULL;
-                p->killed = 1;
-                p->killed_time = time;
-                terminatePCB(p, time);
-                (*terminated)++;
-            }
-            else
-            {
-                PCB *r = removeFromQueue(&readyQ, pid);
-                if (!r)
-                {
-                    r = removeFromQueue(&waitingQ, pid);
-                }
-                if (r)
-                {
-                    r->killed = 1;
-                    r->killed_time = time;
-                    terminatePCB(r, time);
-                    (*terminated)++;
-                }
-            }
-        }
-    }
-}
-
-void simulate()
-{
-    int t = 0;
-    int terminated = 0;
-    PCB *running = NULL;
-
-    while (terminated < totalProcesses)
-    {
-        applyKillEvents(t, &running, &terminated);
-
-        if (!running)
-        {
-            running = dequeue(&readyQ);
-            if (running)
-            {
-                running->state = RUNNING;
-            }
-        }
-
-        if (running)
-        {
-            running->executed_time++;
-            running->cpu_remaining--;
-        }
-
-        forEachQueue(&waitingQ, decIO, NULL);
-
-        if (running)
-        {
-            if (running->cpu_remaining > 0 &&
-                running->io_start >= 0 &&
-                running->executed_time == running->io_start &&
-                running->io_duration > 0)
-            {
-                running->io_remaining = running->io_duration;
-                running->state = WAITING;
-                enqueue(&waitingQ, running);
-                running = NULL;
-            }
-            else if (running->cpu_remaining == 0)
-            {
-                terminatePCB(running, t + 1);
-                running = NULL;
-                terminated++;
-            }
-        }
-
-        checkIOCompletion();
-        t++;
-    }
-}
-
-int cmpPID(const void *a, const void *b)
-{
-    PCB *p1 = *(PCB **)a;
-    PCB *p2 = *(PCB **)b;
-    return p1->pid - p2->pid;
-}
-
-void printResults()
-{
-    PCB *arr[MAX_PROCS];
-    int n = procCount;
-    int anyKilled = 0;
-
-    for (int i = 0; i < n; i++)
-    {
-        arr[i] = procList[i];
-        if (arr[i]->killed)
-        {
-            anyKilled = 1;
-        }
-    }
-
-    qsort(arr, n, sizeof(PCB *), cmpPID);
-
-    if (!anyKilled)
-    {
-        printf("PID\tName\tCPU\tIO\tTurnaround\tWaiting\n");
-        for (int i = 0; i < n; i++)
-        {
-            PCB *p = arr[i];
-            int tat = p->completion_time;
-            int wait = tat - p->cpu_burst;
-            printf("%d\t%s\t%d\t%d\t%d\t\t%d\n", p->pid, p->name, p->cpu_burst, p->io_time_total, tat, wait);
-        }
-    }
-    else
-    {
-        printf("PID\tName\tCPU\tIO\tStatus\t\tTurnaround\tWaiting\n");
-        for (int i = 0; i < n; i++)
-        {
-            PCB *p = arr[i];
-            if (p->killed)
-            {
-                printf("%d\t%s\t%d\t%d\tKILLED at %d\t-\t\t-\n", p->pid, p->name, p->cpu_burst, p->io_time_total, p->killed_time);
-            }
-            else
-            {
-                int tat = p->completion_time;
-                int wait = tat - p->cpu_burst;
-                printf("%d\t%s\t%d\t%d\tOK\t\t%d\t\t%d\n", p->pid, p->name, p->cpu_burst, p->io_time_total, tat, wait);
-            }
-        }
-    }
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_NAME_LEN 64
+#define BURST_CHUNK 4096
+#define TRACE_BUF_SIZE (1 << 20)
+#define TRACE_MAGIC "FCFSTRC1"
+#define TRACE_MAGIC_LEN 8
+#define MLFQ_LEVELS 3
+#define PID_INDEX_MIN 1024
+#define PCB_CHUNK_SHIFT 16
+#define PCB_CHUNK_SIZE (1 << PCB_CHUNK_SHIFT)
+#define NAME_BLOCK_SIZE (1 << 20)
+#define BURST_BLOCK_SIZE (1 << 18)
+#define OUT_BUF_SIZE (1 << 20)
+#define TIMELINE_MAGIC "FCFSTLN1"
+#define TIMELINE_RECORD_SIZE 11
+#define SWEEP_MAX_VALUES 32
+#define IO_WHEEL_BITS 12
+#define IO_WHEEL_SIZE (1 << IO_WHEEL_BITS)
+
+typedef enum
+{
+    NEW,
+    READY,
+    RUNNING,
+    WAITING,
+    TERMINATED
+} State;
+
+typedef enum
+{
+    POLICY_FCFS,
+    POLICY_RR,
+    POLICY_SJF,
+    POLICY_SRTF,
+    POLICY_PRIORITY,
+    POLICY_MLFQ,
+    POLICY_COUNT
+} Policy;
+
+typedef struct PCB
+{
+    char *name;
+    int pid;
+
+    int arrival;
+    int cpu_burst;
+    int cpu_remaining;
+
+    int *bursts;
+    int burst_count;
+    int burst_index;
+    int burst_left;
+
+    int io_remaining;
+    int io_due;
+
+    int executed_time;
+    int completion_time;
+    int io_time_total;
+
+    int killed;
+    int killed_time;
+
+    int priority;
+    int first_run;
+    int cpu;
+    int run_start;
+    int event_seq;
+
+    int level;
+    int boost_epoch;
+    int heap_index;
+    int ready_seq;
+    long long sched_key;
+
+    State state;
+    struct PCB *next;
+    struct PCB *prev;
+} PCB;
+
+typedef struct Queue
+{
+    PCB *front;
+    PCB *rear;
+} Queue;
+
+typedef struct PidSlot
+{
+    int pid;
+    int index;
+} PidSlot;
+
+typedef struct PidIndex
+{
+    PidSlot *slots;
+    unsigned int capacity;
+    unsigned int count;
+} PidIndex;
+
+typedef struct PCBPool
+{
+    PCB **chunks;
+    int chunkCount;
+    int chunkCapacity;
+} PCBPool;
+
+typedef struct NameBlock
+{
+    struct NameBlock *next;
+    size_t used;
+    char data[NAME_BLOCK_SIZE];
+} NameBlock;
+
+typedef struct BurstBlock
+{
+    struct BurstBlock *next;
+    int used;
+    int capacity;
+    int data[];
+} BurstBlock;
+
+typedef struct KillEvent
+{
+    int pid;
+    int time;
+    int seq;
+    int at_proc;
+} KillEvent;
+
+typedef enum
+{
+    EV_CPU,
+    EV_IO_DONE,
+    EV_KILL
+} EventType;
+
+typedef struct Event
+{
+    int time;
+    EventType type;
+    int seq;
+    int pid;
+    PCB *process;
+} Event;
+
+typedef struct EventHeap
+{
+    Event *items;
+    int size;
+    int capacity;
+} EventHeap;
+
+/*
+ * IO completions due within IO_WHEEL_SIZE ticks of the current time sit in the
+ * wheel slot for their due time; later ones wait in the overflow heap and move
+ * into the wheel as time catches up.
+ */
+typedef struct IOWheel
+{
+    Queue slots[IO_WHEEL_SIZE];
+    unsigned long long occupied[IO_WHEEL_SIZE / 64];
+    EventHeap overflow;
+    int base;
+    int count;
+} IOWheel;
+
+typedef struct ReadyHeap
+{
+    PCB **items;
+    int size;
+    int capacity;
+} ReadyHeap;
+
+typedef struct Scheduler
+{
+    Policy policy;
+    int quantum;
+    int aging;
+    int boost;
+
+    Queue levels[MLFQ_LEVELS];
+    ReadyHeap heap;
+    int count;
+    int readySeq;
+    int boostEpoch;
+    int nextBoost;
+} Scheduler;
+
+typedef struct CPU
+{
+    int id;
+    Scheduler sched;
+    PCB *running;
+
+    long long busy;
+    int dispatches;
+    int migrations;
+    int steals;
+} CPU;
+
+typedef struct Machine
+{
+    CPU *cpus;
+    int count;
+    int makespan;
+} Machine;
+
+typedef struct SimConfig
+{
+    Policy policy;
+    int quantum;
+    int aging;
+    int boost;
+    int cpus;
+} SimConfig;
+
+typedef struct RunSummary
+{
+    int completed;
+    int killed;
+    double avgTurnaround;
+    double avgWaiting;
+    double avgResponse;
+    int makespan;
+    int dispatches;
+    int migrations;
+    double imbalance;
+    double throughput;
+    double utilization;
+    int waitP50;
+    int waitP90;
+    int waitP99;
+    int waitMax;
+} RunSummary;
+
+typedef struct SweepRun
+{
+    SimConfig cfg;
+    RunSummary sum;
+    int status;
+} SweepRun;
+
+typedef struct Sweep
+{
+    SweepRun *runs;
+    int count;
+    int next;
+    const PCBPool *trace;
+    pthread_mutex_t lock;
+} Sweep;
+
+typedef struct RealProc
+{
+    PCB *p;
+    pid_t pid;
+    int stopsSent;
+    int burstDone;
+    long long runStart;
+    long long ioDue;
+    long long firstRun;
+    long long finish;
+    int predTurnaround;
+    int predWaiting;
+} RealProc;
+
+typedef struct BurstMsg
+{
+    pid_t pid;
+    int burst;
+} BurstMsg;
+
+typedef struct Timeline
+{
+    FILE *fp;
+    int binary;
+    char *buf;
+    size_t len;
+} Timeline;
+
+unsigned int hashFunction(int key);
+int hashGrow();
+int hashPut(int key, int index);
+PCB *hashGet(int key);
+
+PCB *allocPCB();
+PCB *pcbAt(int index);
+char *storeName(const char *name);
+int *storeBursts(const int *bursts, int count);
+int *reserveBursts(int count);
+int addKillEvent(int pid, int time);
+
+void outFlush();
+void outBytes(const void *data, size_t len);
+void outStr(const char *str);
+int formatInt(char *dst, long long value);
+void outInt(long long value);
+void outRowPrefix(PCB *p);
+
+void initQueue(Queue *q);
+void enqueue(Queue *q, PCB *p);
+PCB *dequeue(Queue *q);
+PCB *removeFromQueue(Queue *q, PCB *p);
+void insertAfter(Queue *q, PCB *after, PCB *p);
+void appendQueue(Queue *dst, Queue *src);
+void forEachQueue(Queue *q, void (*fn)(PCB *, void *), void *ctx);
+
+int eventBefore(const Event *a, const Event *b);
+int heapPush(EventHeap *h, Event ev);
+Event heapPop(EventHeap *h);
+
+void resetIOWheel(IOWheel *w);
+void ioWheelSlotInsert(IOWheel *w, PCB *p);
+void ioWheelAdd(IOWheel *w, PCB *p);
+void ioWheelRemove(IOWheel *w, PCB *p);
+void ioWheelAdvance(IOWheel *w, int now);
+int ioWheelNext(IOWheel *w);
+
+int pcbBefore(const PCB *a, const PCB *b);
+void readyHeapSwap(ReadyHeap *h, int i, int j);
+void readyHeapSiftUp(ReadyHeap *h, int i);
+void readyHeapSiftDown(ReadyHeap *h, int i);
+int readyHeapPush(ReadyHeap *h, PCB *p);
+PCB *readyHeapRemoveAt(ReadyHeap *h, int i);
+
+int parsePolicy(const char *name, Policy *policy);
+void initScheduler(Scheduler *s, Policy policy, int quantum, int aging, int boost);
+void freeScheduler(Scheduler *s);
+void mlfqBoost(Scheduler *s, int now);
+int mlfqLevel(Scheduler *s, PCB *p);
+void schedAdd(Scheduler *s, PCB *p, int now);
+PCB *schedPick(Scheduler *s, int now);
+void schedRemove(Scheduler *s, PCB *p);
+int schedSlice(Scheduler *s, PCB *p);
+void schedExpired(Scheduler *s, PCB *p, int now);
+int schedPreempts(Scheduler *s, PCB *running, int now);
+
+PCB *createPCB(const char *name, int pid, const int *bursts, int count, int io_total);
+void resetPCB(PCB *p);
+void resetProcesses();
+int fillTraceBuffer();
+char *traceLine(char **end);
+int traceBytes(void *dst, size_t n);
+char *nextToken(char **cur, char *end, int *len);
+int scanInt(const char *s, int len, int *out);
+int nextInt(char **cur, char *end, int *out);
+int tokenIs(const char *tok, int len, const char *word);
+void copyName(char *dst, const char *tok, int len);
+void addProcess(const char *name, int pid, int arrival, int priority, const int *bursts, int count, int ioTotal);
+void parseLine(char *line, char *end);
+void parseProcLine(char *cur, char *end);
+int readBinaryRecord();
+int readTraceRecord();
+void writeKill(KillEvent *k, int binary);
+void writeProcess(PCB *p, int binary);
+void writeTrace(int binary);
+void feedTrace(Machine *m, int now, int *nextAdmit, int *killFed);
+void chargeCPU(CPU *cpu, PCB *p, int time);
+void scheduleCPUEvent(PCB *p, int time, int slice);
+void dispatch(CPU *cpu, PCB *p, int now);
+PCB *stealWork(Machine *m, CPU *thief, int now);
+void handleCPUEvent(Machine *m, Event *ev, int *terminated);
+void fireIOCompletions(Machine *m, int now);
+void terminatePCB(PCB *p, int time);
+void applyKillEvent(Machine *m, Event *kill, int *terminated);
+int initMachine(Machine *m, const SimConfig *cfg);
+void freeMachine(Machine *m);
+int simulate(Machine *m);
+int cmpPID(const void *a, const void *b);
+void printResults();
+void printCPUStats(Machine *m);
+double loadImbalance(Machine *m);
+void summarize(Machine *m, RunSummary *sum);
+int cmpInt(const void *a, const void *b);
+int percentile(const int *sorted, int n, int pct);
+void printMetrics(Machine *m);
+
+int openTimeline(const char *path, int binary);
+void timelineFlush();
+void closeTimeline();
+void setState(PCB *p, State state, int now);
+void printComparison(const SimConfig *cfg);
+
+int parseIntList(const char *list, int *values, int min);
+int parsePolicyList(const char *list, Policy *values);
+int copyPool(const PCBPool *src);
+void freeRunState();
+void *sweepWorker(void *arg);
+long long elapsedMs(const struct timespec *start);
+int burnProcess(const char *args);
+RealProc *realByPid(RealProc *real, pid_t pid);
+RealProc *realByPCB(RealProc *real, PCB *p);
+int spawnReal(RealProc *r, int tickMs, int msgFd, const sigset_t *origMask);
+void drainBurstMessages(RealProc *real, int fd);
+void stopReal(Scheduler *s, RealProc *r, long long t, int tickMs, int expired);
+void finishBurst(Scheduler *s, RealProc *r, long long t, int tickMs);
+void printRealResults(RealProc *real, int tickMs);
+int runReal(const SimConfig *cfg, int tickMs);
+int runSweep(const SimConfig *cfg, const Policy *policies, int policyCount, const int *quanta, int quantumCount,
+             const int *cpuCounts, int cpuCountCount, int threads);
+
+const char *policyNames[POLICY_COUNT] = {"FCFS", "RR", "SJF", "SRTF", "PRIORITY", "MLFQ"};
+const char *stateNames[] = {"NEW", "READY", "RUNNING", "WAITING", "TERMINATED"};
+
+/*
+ * The parsed trace (names, bursts, PID index, kills) is shared read-only by
+ * sweep threads; everything a run mutates is per thread, including the PCBs,
+ * which each sweep thread copies from the parsing thread's pool.
+ */
+PidIndex pidIndex;
+__thread PCBPool pcbPool;
+NameBlock *names;
+BurstBlock *burstBlocks;
+__thread Queue terminatedQ;
+__thread IOWheel ioWheel;
+KillEvent *killList;
+int killCapacity = 0;
+
+char outBuf[OUT_BUF_SIZE];
+int outLen = 0;
+__thread Timeline timeline;
+
+__thread EventHeap events;
+__thread EventHeap kills;
+
+int traceFd = STDIN_FILENO;
+int traceEof = 0;
+int traceDone = 0;
+int traceClock = 0;
+int traceRecordNo = 0;
+int lastArrival = 0;
+int *burstBuf;
+int burstCapacity = 0;
+int traceBinary = -1;
+char traceBuf[TRACE_BUF_SIZE];
+size_t tracePos = 0;
+size_t traceLen = 0;
+
+int procCount = 0;
+int killCount = 0;
+__thread int ioSeq = 0;
+__thread int dispatchSeq = 0;
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strncmp(argv[1], "burn=", 5) == 0)
+    {
+        return burnProcess(argv[1] + 5);
+    }
+
+    SimConfig cfg = {POLICY_FCFS, 4, 10, 100, 1};
+    int compare = 0;
+    int convert = -1;
+    int metrics = 0;
+    int sweep = 0;
+    int real = 0;
+    int tickMs = 10;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    Policy policies[POLICY_COUNT];
+    int policyCount = 0;
+    int quanta[SWEEP_MAX_VALUES];
+    int quantumCount = 0;
+    int cpuCounts[SWEEP_MAX_VALUES];
+    int cpuCountCount = 0;
+    const char *timelinePath = NULL;
+    int timelineBinary = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+        if (strncmp(option, "policy=", 7) == 0 && parsePolicy(option + 7, &cfg.policy))
+        {
+            continue;
+        }
+        if (strncmp(option, "quantum=", 8) == 0 && atoi(option + 8) > 0)
+        {
+            cfg.quantum = atoi(option + 8);
+        }
+        else if (strncmp(option, "aging=", 6) == 0 && atoi(option + 6) >= 0)
+        {
+            cfg.aging = atoi(option + 6);
+        }
+        else if (strncmp(option, "boost=", 6) == 0 && atoi(option + 6) >= 0)
+        {
+            cfg.boost = atoi(option + 6);
+        }
+        else if (strncmp(option, "cpus=", 5) == 0 && atoi(option + 5) > 0)
+        {
+            cfg.cpus = atoi(option + 5);
+        }
+        else if (strcmp(option, "compare") == 0)
+        {
+            compare = 1;
+        }
+        else if (strcmp(option, "metrics") == 0)
+        {
+            metrics = 1;
+        }
+        else if (strcmp(option, "sweep") == 0)
+        {
+            sweep = 1;
+        }
+        else if (strcmp(option, "real") == 0)
+        {
+            real = 1;
+        }
+        else if (strncmp(option, "tick_ms=", 8) == 0 && atoi(option + 8) > 0)
+        {
+            tickMs = atoi(option + 8);
+        }
+        else if (strncmp(option, "policies=", 9) == 0 && (policyCount = parsePolicyList(option + 9, policies)) > 0)
+        {
+        }
+        else if (strncmp(option, "quanta=", 7) == 0 && (quantumCount = parseIntList(option + 7, quanta, 1)) > 0)
+        {
+        }
+        else if (strncmp(option, "cpu_counts=", 11) == 0 && (cpuCountCount = parseIntList(option + 11, cpuCounts, 1)) > 0)
+        {
+        }
+        else if (strncmp(option, "threads=", 8) == 0 && atoi(option + 8) > 0)
+        {
+            threads = atoi(option + 8);
+        }
+        else if (strncmp(option, "timeline=", 9) == 0 && option[9])
+        {
+            timelinePath = option + 9;
+        }
+        else if (strcmp(option, "timeline_format=csv") == 0 || strcmp(option, "timeline_format=binary") == 0)
+        {
+            timelineBinary = strcmp(option + 16, "binary") == 0;
+        }
+        else if (strcmp(option, "convert=text") == 0 || strcmp(option, "convert=binary") == 0)
+        {
+            convert = strcmp(option + 8, "binary") == 0;
+        }
+        else
+        {
+            printf("Invalid option %s\n", option);
+            return 1;
+        }
+    }
+
+    initQueue(&terminatedQ);
+
+    if (convert >= 0)
+    {
+        while (readTraceRecord())
+        {
+        }
+        writeTrace(convert);
+        return 0;
+    }
+
+    while (procCount == 0 && readTraceRecord())
+    {
+    }
+
+    if (procCount == 0)
+    {
+        printf("No processes entered.\n");
+        return 0;
+    }
+
+    if (compare)
+    {
+        while (readTraceRecord())
+        {
+        }
+        printComparison(&cfg);
+        return 0;
+    }
+
+    if (real)
+    {
+        while (readTraceRecord())
+        {
+        }
+        if (cfg.cpus != 1)
+        {
+            printf("Real mode runs on one CPU only\n");
+            return 1;
+        }
+        return runReal(&cfg, tickMs) ? 0 : 1;
+    }
+
+    if (sweep)
+    {
+        while (readTraceRecord())
+        {
+        }
+        if (policyCount == 0)
+        {
+            for (int i = 0; i < POLICY_COUNT; i++)
+            {
+                policies[policyCount++] = (Policy)i;
+            }
+        }
+        if (quantumCount == 0)
+        {
+            quanta[quantumCount++] = cfg.quantum;
+        }
+        if (cpuCountCount == 0)
+        {
+            cpuCounts[cpuCountCount++] = cfg.cpus;
+        }
+        return runSweep(&cfg, policies, policyCount, quanta, quantumCount, cpuCounts, cpuCountCount, threads) ? 0 : 1;
+    }
+
+    Machine machine;
+    if (timelinePath && !openTimeline(timelinePath, timelineBinary))
+    {
+        return 1;
+    }
+    if (!initMachine(&machine, &cfg))
+    {
+        closeTimeline();
+        return 1;
+    }
+    if (!simulate(&machine))
+    {
+        closeTimeline();
+        freeMachine(&machine);
+        return 1;
+    }
+    closeTimeline();
+    printResults();
+    if (machine.count > 1)
+    {
+        printCPUStats(&machine);
+    }
+    if (metrics)
+    {
+        printMetrics(&machine);
+    }
+    freeMachine(&machine);
+    return 0;
+}
+
+int fillTraceBuffer()
+{
+    if (traceEof)
+    {
+        return 0;
+    }
+    if (tracePos > 0)
+    {
+        memmove(traceBuf, traceBuf + tracePos, traceLen - tracePos);
+        traceLen -= tracePos;
+        tracePos = 0;
+    }
+    if (traceLen == TRACE_BUF_SIZE)
+    {
+        return 0;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = read(traceFd, traceBuf + traceLen, TRACE_BUF_SIZE - traceLen);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0)
+    {
+        traceEof = 1;
+        return 0;
+    }
+    traceLen += n;
+    return 1;
+}
+
+/* Returns the next line without its newline, or NULL at end of input. */
+char *traceLine(char **end)
+{
+    while (1)
+    {
+        char *start = traceBuf + tracePos;
+        char *nl = (char *)memchr(start, '\n', traceLen - tracePos);
+        if (nl)
+        {
+            *end = nl;
+            tracePos = nl - traceBuf + 1;
+            return start;
+        }
+        if (!fillTraceBuffer())
+        {
+            if (tracePos == traceLen)
+            {
+                return NULL;
+            }
+            start = traceBuf + tracePos;
+            *end = traceBuf + traceLen;
+            tracePos = traceLen;
+            return start;
+        }
+    }
+}
+
+int traceBytes(void *dst, size_t n)
+{
+    while (traceLen - tracePos < n)
+    {
+        if (!fillTraceBuffer())
+        {
+            return 0;
+        }
+    }
+    memcpy(dst, traceBuf + tracePos, n);
+    tracePos += n;
+    return 1;
+}
+
+char *nextToken(char **cur, char *end, int *len)
+{
+    char *p = *cur;
+    while (p < end && isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    if (p == end)
+    {
+        *cur = p;
+        return NULL;
+    }
+
+    char *start = p;
+    while (p < end && !isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    *len = p - start;
+    *cur = p;
+    return start;
+}
+
+/* Reads the leading integer of a token the way atoi would; fails if there are no digits. */
+int scanInt(const char *s, int len, int *out)
+{
+    int i = 0;
+    int neg = 0;
+    long long v = 0;
+
+    if (i < len && (s[i] == '-' || s[i] == '+'))
+    {
+        neg = s[i] == '-';
+        i++;
+    }
+    if (i == len || !isdigit((unsigned char)s[i]))
+    {
+        return 0;
+    }
+    while (i < len && isdigit((unsigned char)s[i]))
+    {
+        if (v <= INT_MAX)
+        {
+            v = v * 10 + (s[i] - '0');
+        }
+        i++;
+    }
+
+    if (v > INT_MAX)
+    {
+        v = neg ? (long long)INT_MAX + 1 : INT_MAX;
+    }
+    *out = (int)(neg ? -v : v);
+    return 1;
+}
+
+int nextInt(char **cur, char *end, int *out)
+{
+    int len;
+    char *tok = nextToken(cur, end, &len);
+    return tok && scanInt(tok, len, out);
+}
+
+int tokenIs(const char *tok, int len, const char *word)
+{
+    return len == (int)strlen(word) && strncasecmp(tok, word, len) == 0;
+}
+
+void copyName(char *dst, const char *tok, int len)
+{
+    if (len >= MAX_NAME_LEN)
+    {
+        len = MAX_NAME_LEN - 1;
+    }
+    memcpy(dst, tok, len);
+    dst[len] = '\0';
+}
+
+void addProcess(const char *name, int pid, int arrival, int priority, const int *bursts, int count, int ioTotal)
+{
+    if (hashGet(pid))
+    {
+        return;
+    }
+
+    PCB *p = createPCB(name, pid, bursts, count, ioTotal);
+    if (!p)
+    {
+        return;
+    }
+
+    if (arrival < lastArrival)
+    {
+        fprintf(stderr, "Warning: PID %d arrives at %d after a process arriving at %d; it is admitted late\n",
+                pid, arrival, lastArrival);
+    }
+    else
+    {
+        lastArrival = arrival;
+    }
+
+    p->arrival = arrival;
+    p->priority = priority;
+    hashPut(pid, procCount - 1);
+}
+
+/*
+ * Text input lines:
+ *   name pid burst [io_start io_duration [priority]]   one IO, arrives at 0
+ *   PROC name pid arrival priority cpu [io cpu]...     any number of bursts
+ *   KILL pid time
+ * A binary trace starts with TRACE_MAGIC and holds the same records; see
+ * writeTrace. Either way the trace is read lazily as the simulation reaches
+ * each arrival, so processes are expected in arrival order and a KILL has to
+ * come before any process arriving after its time. A process listed after a
+ * later arrival is admitted late, and a KILL read after its time has passed
+ * is dropped; both are reported on stderr when the record is read, so compare
+ * and sweep runs do not repeat the warning.
+ */
+void parseLine(char *line, char *end)
+{
+    char *cur = line;
+    int len;
+    char *first = nextToken(&cur, end, &len);
+
+    if (!first)
+    {
+        return;
+    }
+    if (tokenIs(first, len, "KILL"))
+    {
+        int pid, time_val;
+        if (nextInt(&cur, end, &pid) && nextInt(&cur, end, &time_val))
+        {
+            addKillEvent(pid, time_val);
+        }
+        return;
+    }
+    if (tokenIs(first, len, "PROC"))
+    {
+        parseProcLine(cur, end);
+        return;
+    }
+
+    char name[MAX_NAME_LEN];
+    int pid, burst, priority = 0;
+
+    copyName(name, first, len);
+    if (!nextInt(&cur, end, &pid) || !nextInt(&cur, end, &burst))
+    {
+        return;
+    }
+
+    int io_start = -1, io_dur = 0;
+    int len1, len2;
+    char *io1 = nextToken(&cur, end, &len1);
+    char *io2 = io1 ? nextToken(&cur, end, &len2) : NULL;
+
+    if (io2)
+    {
+        if (!(len1 == 1 && io1[0] == '-'))
+        {
+            io_start = 0;
+            scanInt(io1, len1, &io_start);
+        }
+        if (!(len2 == 1 && io2[0] == '-'))
+        {
+            scanInt(io2, len2, &io_dur);
+        }
+        nextInt(&cur, end, &priority);
+    }
+
+    if (burst < 0 || io_dur < 0)
+    {
+        return;
+    }
+
+    int bursts[3] = {burst, 0, 0};
+    int count = 1;
+    if (io_start > 0 && io_start < burst && io_dur > 0)
+    {
+        bursts[0] = io_start;
+        bursts[1] = io_dur;
+        bursts[2] = burst - io_start;
+        count = 3;
+    }
+
+    addProcess(name, pid, 0, priority, bursts, count, io_dur);
+}
+
+void parseProcLine(char *cur, char *end)
+{
+    char name[MAX_NAME_LEN];
+    int pid, arrival, priority, len;
+    char *tok = nextToken(&cur, end, &len);
+
+    if (!tok || !nextInt(&cur, end, &pid) || !nextInt(&cur, end, &arrival) ||
+        !nextInt(&cur, end, &priority) || arrival < 0)
+    {
+        fprintf(stderr, "Warning: line %d: malformed PROC header; skipped\n", traceRecordNo);
+        return;
+    }
+    copyName(name, tok, len);
+
+    int count = 0;
+    int ioTotal = 0;
+
+    while ((tok = nextToken(&cur, end, &len)))
+    {
+        int value;
+        if (!scanInt(tok, len, &value) || value < (count % 2 == 0 ? 1 : 0))
+        {
+            fprintf(stderr, "Warning: line %d: PID %d has an invalid burst %.*s; skipped\n",
+                    traceRecordNo, pid, len, tok);
+            return;
+        }
+        if (!reserveBursts(count + 1))
+        {
+            return;
+        }
+        if (count % 2 == 1)
+        {
+            ioTotal += value;
+        }
+        burstBuf[count++] = value;
+    }
+
+    if (count % 2 == 0)
+    {
+        fprintf(stderr, "Warning: line %d: PID %d must end with a CPU burst; skipped\n", traceRecordNo, pid);
+        return;
+    }
+    addProcess(name, pid, arrival, priority, burstBuf, count, ioTotal);
+}
+
+/*
+ * Binary records, host byte order:
+ *   'K' int32 pid, int32 time
+ *   'P' int32 pid, arrival, priority, io_total, burst_count,
+ *       uint8 name_len, name bytes, int32 bursts[burst_count]
+ */
+int readBinaryRecord()
+{
+    unsigned char type;
+    if (!traceBytes(&type, 1))
+    {
+        return 0;
+    }
+
+    if (type == 'K')
+    {
+        int32_t kill[2];
+        if (!traceBytes(kill, sizeof(kill)))
+        {
+            printf("Corrupt binary trace\n");
+            return 0;
+        }
+        addKillEvent(kill[0], kill[1]);
+        return 1;
+    }
+
+    int32_t hdr[5];
+    unsigned char nameLen;
+    char name[MAX_NAME_LEN];
+
+    if (type != 'P' || !traceBytes(hdr, sizeof(hdr)) || !traceBytes(&nameLen, 1) ||
+        nameLen >= MAX_NAME_LEN || !traceBytes(name, nameLen) ||
+        hdr[4] < 1 || hdr[4] % 2 == 0)
+    {
+        printf("Corrupt binary trace\n");
+        return 0;
+    }
+    name[nameLen] = '\0';
+
+    /* Grow by chunks as bursts arrive so a corrupt count cannot force a huge allocation. */
+    for (int got = 0; got < hdr[4];)
+    {
+        int chunk = hdr[4] - got < BURST_CHUNK ? hdr[4] - got : BURST_CHUNK;
+        if (!reserveBursts(got + chunk))
+        {
+            return 0;
+        }
+        if (!traceBytes(burstBuf + got, chunk * sizeof(int32_t)))
+        {
+            printf("Corrupt binary trace\n");
+            return 0;
+        }
+        got += chunk;
+    }
+
+    addProcess(name, hdr[0], hdr[1], hdr[2], burstBuf, hdr[4], hdr[3]);
+    return 1;
+}
+
+int readTraceRecord()
+{
+    if (traceDone)
+    {
+        return 0;
+    }
+
+    if (traceBinary < 0)
+    {
+        while (traceLen - tracePos < TRACE_MAGIC_LEN && fillTraceBuffer())
+        {
+        }
+        traceBinary = traceLen - tracePos >= TRACE_MAGIC_LEN &&
+                      memcmp(traceBuf + tracePos, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+        if (traceBinary)
+        {
+            tracePos += TRACE_MAGIC_LEN;
+        }
+    }
+
+    if (traceBinary)
+    {
+        if (!readBinaryRecord())
+        {
+            traceDone = 1;
+            return 0;
+        }
+        return 1;
+    }
+
+    char *end;
+    char *line = traceLine(&end);
+    if (!line)
+    {
+        traceDone = 1;
+        return 0;
+    }
+    traceRecordNo++;
+    parseLine(line, end);
+    return 1;
+}
+
+void writeKill(KillEvent *k, int binary)
+{
+    if (binary)
+    {
+        int32_t kill[2] = {k->pid, k->time};
+        outBytes("K", 1);
+        outBytes(kill, sizeof(kill));
+        return;
+    }
+
+    outStr("KILL ");
+    outInt(k->pid);
+    outStr(" ");
+    outInt(k->time);
+    outStr("\n");
+}
+
+/* Processes the legacy line format can express exactly are written in it. */
+void writeProcess(PCB *p, int binary)
+{
+    if (binary)
+    {
+        int32_t hdr[5] = {p->pid, p->arrival, p->priority, p->io_time_total, p->burst_count};
+        unsigned char nameLen = (unsigned char)strlen(p->name);
+        outBytes("P", 1);
+        outBytes(hdr, sizeof(hdr));
+        outBytes(&nameLen, 1);
+        outBytes(p->name, nameLen);
+        outBytes(p->bursts, p->burst_count * sizeof(int32_t));
+        return;
+    }
+
+    int *b = p->bursts;
+    int legacy = p->arrival == 0 && !tokenIs(p->name, strlen(p->name), "KILL") &&
+                 !tokenIs(p->name, strlen(p->name), "PROC") &&
+                 (p->burst_count == 1 ||
+                  (p->burst_count == 3 && b[0] > 0 && b[1] > 0 && b[2] > 0 && p->io_time_total == b[1]));
+
+    if (!legacy)
+    {
+        outStr("PROC ");
+    }
+    outStr(p->name);
+    outStr(" ");
+    outInt(p->pid);
+    outStr(" ");
+
+    if (legacy)
+    {
+        outInt(p->cpu_burst);
+        if (p->burst_count == 3)
+        {
+            outStr(" ");
+            outInt(b[0]);
+        }
+        else
+        {
+            outStr(p->io_time_total ? " 0" : " -");
+        }
+        outStr(" ");
+        outInt(p->io_time_total);
+        outStr(" ");
+        outInt(p->priority);
+        outStr("\n");
+        return;
+    }
+
+    outInt(p->arrival);
+    outStr(" ");
+    outInt(p->priority);
+    for (int i = 0; i < p->burst_count; i++)
+    {
+        outStr(" ");
+        outInt(b[i]);
+    }
+    outStr("\n");
+}
+
+/* Writes everything read so far, with KILL lines kept at their place among the processes. */
+void writeTrace(int binary)
+{
+    int k = 0;
+
+    if (binary)
+    {
+        outBytes(TRACE_MAGIC, TRACE_MAGIC_LEN);
+    }
+    for (int i = 0; i <= procCount; i++)
+    {
+        while (k < killCount && killList[k].at_proc <= i)
+        {
+            writeKill(&killList[k++], binary);
+        }
+        if (i < procCount)
+        {
+            writeProcess(pcbAt(i), binary);
+        }
+    }
+    outFlush();
+    fflush(stdout);
+}
+
+/*
+ * Admits every process that has arrived by `now`, reading further lines only
+ * while the next process is not known yet. Processes already in memory are
+ * replayed from the pool, so repeated runs over a fully read trace work the
+ * same way.
+ */
+void feedTrace(Machine *m, int now, int *nextAdmit, int *killFed)
+{
+    while (1)
+    {
+        while (*killFed < killCount)
+        {
+            KillEvent *k = &killList[(*killFed)++];
+            if (k->time >= now)
+            {
+                Event ev = {k->time, EV_KILL, k->seq, k->pid, NULL};
+                heapPush(&kills, ev);
+            }
+        }
+
+        if (*nextAdmit < procCount)
+        {
+            PCB *p = pcbAt(*nextAdmit);
+            if (p->arrival > now)
+            {
+                return;
+            }
+            p->cpu = *nextAdmit % m->count;
+            setState(p, READY, now);
+            schedAdd(&m->cpus[p->cpu].sched, p, now);
+            (*nextAdmit)++;
+            continue;
+        }
+
+        if (traceDone)
+        {
+            return;
+        }
+        traceClock = now;
+        if (!readTraceRecord())
+        {
+            return;
+        }
+    }
+}
+
+unsigned int hashFunction(int key)
+{
+    return ((unsigned int)key * 2654435761u) & (pidIndex.capacity - 1);
+}
+
+int hashGrow()
+{
+    unsigned int capacity = pidIndex.capacity ? pidIndex.capacity * 2 : PID_INDEX_MIN;
+    PidSlot *slots = (PidSlot *)malloc(capacity * sizeof(PidSlot));
+    if (!slots)
+    {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    for (unsigned int i = 0; i < capacity; i++)
+    {
+        slots[i].index = -1;
+    }
+
+    PidSlot *old = pidIndex.slots;
+    unsigned int oldCapacity = pidIndex.capacity;
+    pidIndex.slots = slots;
+    pidIndex.capacity = capacity;
+
+    for (unsigned int i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].index >= 0)
+        {
+            unsigned int idx = hashFunction(old[i].pid);
+            while (slots[idx].index >= 0)
+            {
+                idx = (idx + 1) & (capacity - 1);
+            }
+            slots[idx] = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+/* Open addressing with linear probing, kept at most three quarters full. */
+int hashPut(int key, int index)
+{
+    if ((pidIndex.count + 1) * 4 > pidIndex.capacity * 3 && !hashGrow())
+    {
+        return 0;
+    }
+
+    unsigned int idx = hashFunction(key);
+    while (pidIndex.slots[idx].index >= 0)
+    {
+        if (pidIndex.slots[idx].pid == key)
+        {
+            return 1;
+        }
+        idx = (idx + 1) & (pidIndex.capacity - 1);
+    }
+
+    pidIndex.slots[idx].pid = key;
+    pidIndex.slots[idx].index = index;
+    pidIndex.count++;
+    return 1;
+}
+
+PCB *hashGet(int key)
+{
+    if (pidIndex.capacity == 0)
+    {
+        return NULL;
+    }
+
+    unsigned int idx = hashFunction(key);
+    while (pidIndex.slots[idx].index >= 0)
+    {
+        if (pidIndex.slots[idx].pid == key)
+        {
+            return pcbAt(pidIndex.slots[idx].index);
+        }
+        idx = (idx + 1) & (pidIndex.capacity - 1);
+    }
+    return NULL;
+}
+
+/* PCBs live in fixed-size chunks, so they never move and can be found by parse order. */
+PCB *allocPCB()
+{
+    if (procCount == pcbPool.chunkCount * PCB_CHUNK_SIZE)
+    {
+        if (pcbPool.chunkCount == pcbPool.chunkCapacity)
+        {
+            int cap = pcbPool.chunkCapacity ? pcbPool.chunkCapacity * 2 : 16;
+            PCB **chunks = (PCB **)realloc(pcbPool.chunks, cap * sizeof(PCB *));
+            if (!chunks)
+            {
+                printf("Memory allocation failed\n");
+                return NULL;
+            }
+            pcbPool.chunks = chunks;
+            pcbPool.chunkCapacity = cap;
+        }
+
+        PCB *chunk = (PCB *)malloc(PCB_CHUNK_SIZE * sizeof(PCB));
+        if (!chunk)
+        {
+            printf("Memory allocation failed\n");
+            return NULL;
+        }
+        pcbPool.chunks[pcbPool.chunkCount++] = chunk;
+    }
+
+    return pcbAt(procCount++);
+}
+
+PCB *pcbAt(int index)
+{
+    return &pcbPool.chunks[index >> PCB_CHUNK_SHIFT][index & (PCB_CHUNK_SIZE - 1)];
+}
+
+int *storeBursts(const int *bursts, int count)
+{
+    if (!burstBlocks || burstBlocks->used + count > burstBlocks->capacity)
+    {
+        int capacity = count > BURST_BLOCK_SIZE ? count : BURST_BLOCK_SIZE;
+        BurstBlock *block = (BurstBlock *)malloc(sizeof(BurstBlock) + capacity * sizeof(int));
+        if (!block)
+        {
+            printf("Memory allocation failed\n");
+            return NULL;
+        }
+        block->next = burstBlocks;
+        block->used = 0;
+        block->capacity = capacity;
+        burstBlocks = block;
+    }
+
+    int *dst = burstBlocks->data + burstBlocks->used;
+    memcpy(dst, bursts, count * sizeof(int));
+    burstBlocks->used += count;
+    return dst;
+}
+
+/* Scratch space the trace readers parse one record's bursts into. */
+int *reserveBursts(int count)
+{
+    if (count > burstCapacity)
+    {
+        int cap = burstCapacity ? burstCapacity : BURST_CHUNK;
+        while (cap < count)
+        {
+            cap *= 2;
+        }
+        int *buf = (int *)realloc(burstBuf, cap * sizeof(int));
+        if (!buf)
+        {
+            printf("Memory allocation failed\n");
+            return NULL;
+        }
+        burstBuf = buf;
+        burstCapacity = cap;
+    }
+    return burstBuf;
+}
+
+char *storeName(const char *name)
+{
+    size_t len = strlen(name) + 1;
+
+    if (!names || names->used + len > NAME_BLOCK_SIZE)
+    {
+        NameBlock *block = (NameBlock *)malloc(sizeof(NameBlock));
+        if (!block)
+        {
+            printf("Memory allocation failed\n");
+            return NULL;
+        }
+        block->next = names;
+        block->used = 0;
+        names = block;
+    }
+
+    char *dst = names->data + names->used;
+    memcpy(dst, name, len);
+    names->used += len;
+    return dst;
+}
+
+int addKillEvent(int pid, int time)
+{
+    if (killCount == killCapacity)
+    {
+        int cap = killCapacity ? killCapacity * 2 : 64;
+        KillEvent *list = (KillEvent *)realloc(killList, cap * sizeof(KillEvent));
+        if (!list)
+        {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        killList = list;
+        killCapacity = cap;
+    }
+
+    if (time < traceClock)
+    {
+        fprintf(stderr, "Warning: KILL %d at %d read at time %d; ignored\n", pid, time, traceClock);
+    }
+
+    killList[killCount].pid = pid;
+    killList[killCount].time = time;
+    killList[killCount].seq = killCount;
+    killList[killCount].at_proc = procCount;
+    killCount++;
+    return 1;
+}
+
+int eventBefore(const Event *a, const Event *b)
+{
+    if (a->time != b->time)
+    {
+        return a->time < b->time;
+    }
+    if (a->type != b->type)
+    {
+        return a->type < b->type;
+    }
+    return a->seq < b->seq;
+}
+
+int heapPush(EventHeap *h, Event ev)
+{
+    if (h->size == h->capacity)
+    {
+        int cap = h->capacity ? h->capacity * 2 : 64;
+        Event *items = (Event *)realloc(h->items, cap * sizeof(Event));
+        if (!items)
+        {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        h->items = items;
+        h->capacity = cap;
+    }
+
+    int i = h->size++;
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!eventBefore(&ev, &h->items[parent]))
+        {
+            break;
+        }
+        h->items[i] = h->items[parent];
+        i = parent;
+    }
+    h->items[i] = ev;
+    return 1;
+}
+
+Event heapPop(EventHeap *h)
+{
+    Event top = h->items[0];
+    Event last = h->items[--h->size];
+    int i = 0;
+
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= h->size)
+        {
+            break;
+        }
+        if (child + 1 < h->size && eventBefore(&h->items[child + 1], &h->items[child]))
+        {
+            child++;
+        }
+        if (!eventBefore(&h->items[child], &last))
+        {
+            break;
+        }
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    if (h->size > 0)
+    {
+        h->items[i] = last;
+    }
+    return top;
+}
+
+void initQueue(Queue *q)
+{
+    q->front = q->rear = NULL;
+}
+
+void enqueue(Queue *q, PCB *p)
+{
+    p->next = NULL;
+    p->prev = q->rear;
+    if (q->rear)
+    {
+        q->rear->next = p;
+        q->rear = p;
+    }
+    else
+    {
+        q->front = q->rear = p;
+    }
+}
+
+PCB *dequeue(Queue *q)
+{
+    if (!q->front)
+    {
+        return NULL;
+    }
+    PCB *p = q->front;
+    q->front = p->next;
+    if (q->front)
+    {
+        q->front->prev = NULL;
+    }
+    else
+    {
+        q->rear = NULL;
+    }
+    p->next = NULL;
+    return p;
+}
+
+/* p must currently be linked into q. */
+PCB *removeFromQueue(Queue *q, PCB *p)
+{
+    if (p->prev)
+    {
+        p->prev->next = p->next;
+    }
+    else
+    {
+        q->front = p->next;
+    }
+    if (p->next)
+    {
+        p->next->prev = p->prev;
+    }
+    else
+    {
+        q->rear = p->prev;
+    }
+    p->next = p->prev = NULL;
+    return p;
+}
+
+/* Links p in right after `after`, or at the front when `after` is NULL. */
+void insertAfter(Queue *q, PCB *after, PCB *p)
+{
+    p->prev = after;
+    p->next = after ? after->next : q->front;
+    if (p->next)
+    {
+        p->next->prev = p;
+    }
+    else
+    {
+        q->rear = p;
+    }
+    if (after)
+    {
+        after->next = p;
+    }
+    else
+    {
+        q->front = p;
+    }
+}
+
+void appendQueue(Queue *dst, Queue *src)
+{
+    if (!src->front)
+    {
+        return;
+    }
+    src->front->prev = dst->rear;
+    if (dst->rear)
+    {
+        dst->rear->next = src->front;
+    }
+    else
+    {
+        dst->front = src->front;
+    }
+    dst->rear = src->rear;
+    initQueue(src);
+}
+
+void forEachQueue(Queue *q, void (*fn)(PCB *, void *), void *ctx)
+{
+    PCB *cur = q->front;
+    while (cur)
+    {
+        PCB *nxt = cur->next;
+        fn(cur, ctx);
+        cur = nxt;
+    }
+}
+
+void resetIOWheel(IOWheel *w)
+{
+    for (int i = 0; i < IO_WHEEL_SIZE; i++)
+    {
+        initQueue(&w->slots[i]);
+    }
+    memset(w->occupied, 0, sizeof(w->occupied));
+    w->overflow.size = 0;
+    w->base = 0;
+    w->count = 0;
+}
+
+/* A slot only ever holds one completion time, kept in the order the processes blocked. */
+void ioWheelSlotInsert(IOWheel *w, PCB *p)
+{
+    int slot = p->io_due & (IO_WHEEL_SIZE - 1);
+    Queue *q = &w->slots[slot];
+    PCB *after = q->rear;
+
+    while (after && after->event_seq > p->event_seq)
+    {
+        after = after->prev;
+    }
+    insertAfter(q, after, p);
+
+    w->occupied[slot >> 6] |= 1ULL << (slot & 63);
+    w->count++;
+}
+
+void ioWheelAdd(IOWheel *w, PCB *p)
+{
+    if (p->io_due - w->base < IO_WHEEL_SIZE)
+    {
+        ioWheelSlotInsert(w, p);
+        return;
+    }
+
+    Event ev = {p->io_due, EV_IO_DONE, p->event_seq, p->pid, p};
+    heapPush(&w->overflow, ev);
+}
+
+/* Overflow entries are left in place and skipped once the process is no longer waiting. */
+void ioWheelRemove(IOWheel *w, PCB *p)
+{
+    if (p->io_due - w->base >= IO_WHEEL_SIZE)
+    {
+        return;
+    }
+
+    int slot = p->io_due & (IO_WHEEL_SIZE - 1);
+    removeFromQueue(&w->slots[slot], p);
+    if (!w->slots[slot].front)
+    {
+        w->occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+    }
+    w->count--;
+}
+
+void ioWheelAdvance(IOWheel *w, int now)
+{
+    w->base = now;
+    while (w->overflow.size > 0 && w->overflow.items[0].time - now < IO_WHEEL_SIZE)
+    {
+        Event ev = heapPop(&w->overflow);
+        PCB *p = ev.process;
+        if (p->state == WAITING && p->event_seq == ev.seq)
+        {
+            ioWheelSlotInsert(w, p);
+        }
+    }
+}
+
+int ioWheelNext(IOWheel *w)
+{
+    if (w->count > 0)
+    {
+        int start = w->base & (IO_WHEEL_SIZE - 1);
+        for (int i = 0; i <= IO_WHEEL_SIZE / 64; i++)
+        {
+            int word = ((start >> 6) + i) & (IO_WHEEL_SIZE / 64 - 1);
+            unsigned long long bits = w->occupied[word];
+            if (i == 0)
+            {
+                bits &= ~0ULL << (start & 63);
+            }
+            if (bits)
+            {
+                int slot = (word << 6) + __builtin_ctzll(bits);
+                return w->base + ((slot - start) & (IO_WHEEL_SIZE - 1));
+            }
+        }
+    }
+
+    while (w->overflow.size > 0)
+    {
+        PCB *p = w->overflow.items[0].process;
+        if (p->state == WAITING && p->event_seq == w->overflow.items[0].seq)
+        {
+            return w->overflow.items[0].time;
+        }
+        heapPop(&w->overflow);
+    }
+    return INT_MAX;
+}
+
+void fireIOCompletions(Machine *m, int now)
+{
+    int slot = now & (IO_WHEEL_SIZE - 1);
+    PCB *p;
+
+    while ((p = dequeue(&ioWheel.slots[slot])))
+    {
+        ioWheel.count--;
+        p->io_remaining = 0;
+        setState(p, READY, now);
+        schedAdd(&m->cpus[p->cpu].sched, p, now);
+    }
+    ioWheel.occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+}
+
+int pcbBefore(const PCB *a, const PCB *b)
+{
+    if (a->sched_key != b->sched_key)
+    {
+        return a->sched_key < b->sched_key;
+    }
+    return a->ready_seq < b->ready_seq;
+}
+
+void readyHeapSwap(ReadyHeap *h, int i, int j)
+{
+    PCB *tmp = h->items[i];
+    h->items[i] = h->items[j];
+    h->items[j] = tmp;
+    h->items[i]->heap_index = i;
+    h->items[j]->heap_index = j;
+}
+
+void readyHeapSiftUp(ReadyHeap *h, int i)
+{
+    while (i > 0 && pcbBefore(h->items[i], h->items[(i - 1) / 2]))
+    {
+        readyHeapSwap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void readyHeapSiftDown(ReadyHeap *h, int i)
+{
+    while (1)
+    {
+        int best = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < h->size && pcbBefore(h->items[left], h->items[best]))
+        {
+            best = left;
+        }
+        if (right < h->size && pcbBefore(h->items[right], h->items[best]))
+        {
+            best = right;
+        }
+        if (best == i)
+        {
+            return;
+        }
+        readyHeapSwap(h, i, best);
+        i = best;
+    }
+}
+
+int readyHeapPush(ReadyHeap *h, PCB *p)
+{
+    if (h->size == h->capacity)
+    {
+        int cap = h->capacity ? h->capacity * 2 : 64;
+        PCB **items = (PCB **)realloc(h->items, cap * sizeof(PCB *));
+        if (!items)
+        {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        h->items = items;
+        h->capacity = cap;
+    }
+
+    p->heap_index = h->size;
+    h->items[h->size++] = p;
+    readyHeapSiftUp(h, p->heap_index);
+    return 1;
+}
+
+PCB *readyHeapRemoveAt(ReadyHeap *h, int i)
+{
+    if (i < 0 || i >= h->size)
+    {
+        return NULL;
+    }
+
+    PCB *p = h->items[i];
+    h->size--;
+    if (i != h->size)
+    {
+        h->items[i] = h->items[h->size];
+        h->items[i]->heap_index = i;
+        readyHeapSiftUp(h, i);
+        readyHeapSiftDown(h, h->items[i]->heap_index);
+    }
+    p->heap_index = -1;
+    return p;
+}
+
+int parsePolicy(const char *name, Policy *policy)
+{
+    for (int i = 0; i < POLICY_COUNT; i++)
+    {
+        if (strcasecmp(name, policyNames[i]) == 0)
+        {
+            *policy = (Policy)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void initScheduler(Scheduler *s, Policy policy, int quantum, int aging, int boost)
+{
+    s->policy = policy;
+    s->quantum = quantum;
+    s->aging = aging;
+    s->boost = boost;
+
+    for (int i = 0; i < MLFQ_LEVELS; i++)
+    {
+        initQueue(&s->levels[i]);
+    }
+    s->heap.items = NULL;
+    s->heap.size = s->heap.capacity = 0;
+    s->count = 0;
+    s->readySeq = 0;
+    s->boostEpoch = 0;
+    s->nextBoost = boost;
+}
+
+void freeScheduler(Scheduler *s)
+{
+    free(s->heap.items);
+    s->heap.items = NULL;
+    s->heap.size = s->heap.capacity = 0;
+}
+
+/*
+ * Moves every MLFQ level back to the top once per boost period. It runs lazily
+ * before each queue operation, which orders processes exactly as an eager boost
+ * at the period boundary would, since nothing looks at the levels in between.
+ */
+void mlfqBoost(Scheduler *s, int now)
+{
+    if (s->boost <= 0 || now < s->nextBoost)
+    {
+        return;
+    }
+
+    for (int i = 1; i < MLFQ_LEVELS; i++)
+    {
+        appendQueue(&s->levels[0], &s->levels[i]);
+    }
+    s->boostEpoch++;
+    s->nextBoost = (now / s->boost + 1) * s->boost;
+}
+
+int mlfqLevel(Scheduler *s, PCB *p)
+{
+    if (p->boost_epoch != s->boostEpoch)
+    {
+        p->boost_epoch = s->boostEpoch;
+        p->level = 0;
+    }
+    return p->level;
+}
+
+/*
+ * SJF and SRTF order by remaining CPU time. PRIORITY ages a waiting process by
+ * one level every `aging` ticks, so its effective priority at time t is
+ * priority - (t - readySince) / aging; comparing that for two processes is the
+ * same as comparing priority * aging + readySince, which never changes while
+ * the process waits and can live in the heap as a fixed key.
+ */
+void schedAdd(Scheduler *s, PCB *p, int now)
+{
+    p->ready_seq = s->readySeq++;
+    s->count++;
+
+    switch (s->policy)
+    {
+    case POLICY_SJF:
+    case POLICY_SRTF:
+        p->sched_key = p->cpu_remaining;
+        readyHeapPush(&s->heap, p);
+        break;
+    case POLICY_PRIORITY:
+        p->sched_key = s->aging > 0 ? (long long)p->priority * s->aging + now : p->priority;
+        readyHeapPush(&s->heap, p);
+        break;
+    case POLICY_MLFQ:
+        mlfqBoost(s, now);
+        enqueue(&s->levels[mlfqLevel(s, p)], p);
+        break;
+    default:
+        enqueue(&s->levels[0], p);
+        break;
+    }
+}
+
+PCB *schedPick(Scheduler *s, int now)
+{
+    if (s->count == 0)
+    {
+        return NULL;
+    }
+    s->count--;
+
+    switch (s->policy)
+    {
+    case POLICY_SJF:
+    case POLICY_SRTF:
+    case POLICY_PRIORITY:
+        return readyHeapRemoveAt(&s->heap, 0);
+    case POLICY_MLFQ:
+        mlfqBoost(s, now);
+        for (int i = 0; i < MLFQ_LEVELS; i++)
+        {
+            PCB *p = dequeue(&s->levels[i]);
+            if (p)
+            {
+                mlfqLevel(s, p);
+                return p;
+            }
+        }
+        return NULL;
+    default:
+        return dequeue(&s->levels[0]);
+    }
+}
+
+void schedRemove(Scheduler *s, PCB *p)
+{
+    s->count--;
+
+    switch (s->policy)
+    {
+    case POLICY_SJF:
+    case POLICY_SRTF:
+    case POLICY_PRIORITY:
+        readyHeapRemoveAt(&s->heap, p->heap_index);
+        break;
+    case POLICY_MLFQ:
+        removeFromQueue(&s->levels[mlfqLevel(s, p)], p);
+        break;
+    default:
+        removeFromQueue(&s->levels[0], p);
+        break;
+    }
+}
+
+int schedSlice(Scheduler *s, PCB *p)
+{
+    if (s->policy == POLICY_RR)
+    {
+        return s->quantum;
+    }
+    if (s->policy == POLICY_MLFQ)
+    {
+        return s->quantum << p->level;
+    }
+    return 0;
+}
+
+void schedExpired(Scheduler *s, PCB *p, int now)
+{
+    if (s->policy != POLICY_MLFQ)
+    {
+        return;
+    }
+
+    mlfqBoost(s, now);
+    int level = mlfqLevel(s, p);
+    if (level < MLFQ_LEVELS - 1)
+    {
+        p->level = level + 1;
+    }
+}
+
+int schedPreempts(Scheduler *s, PCB *running, int now)
+{
+    if (s->policy == POLICY_SRTF)
+    {
+        return s->heap.size > 0 && s->heap.items[0]->cpu_remaining < running->cpu_remaining;
+    }
+
+    if (s->policy == POLICY_MLFQ)
+    {
+        mlfqBoost(s, now);
+        int level = mlfqLevel(s, running);
+        for (int i = 0; i < level; i++)
+        {
+            if (s->levels[i].front)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* bursts alternates CPU and IO lengths and starts and ends with a CPU burst. */
+PCB *createPCB(const char *name, int pid, const int *bursts, int count, int io_total)
+{
+    char *stored = storeName(name);
+    int *storedBursts = storeBursts(bursts, count);
+    if (!stored || !storedBursts)
+    {
+        return NULL;
+    }
+    PCB *p = allocPCB();
+    if (!p)
+    {
+        return NULL;
+    }
+    p->name = stored;
+
+    p->pid = pid;
+    p->arrival = 0;
+    p->cpu_burst = 0;
+    for (int i = 0; i < count; i += 2)
+    {
+        p->cpu_burst += bursts[i];
+    }
+
+    p->bursts = storedBursts;
+    p->burst_count = count;
+    p->io_time_total = io_total;
+    p->priority = 0;
+
+    resetPCB(p);
+    return p;
+}
+
+void resetPCB(PCB *p)
+{
+    p->cpu_remaining = p->cpu_burst;
+    p->burst_index = 0;
+    p->burst_left = p->bursts[0];
+    p->io_remaining = 0;
+    p->io_due = 0;
+
+    p->executed_time = 0;
+    p->completion_time = -1;
+    p->killed = 0;
+    p->killed_time = -1;
+    p->first_run = -1;
+    p->cpu = -1;
+    p->run_start = 0;
+    p->event_seq = -1;
+
+    p->level = 0;
+    p->boost_epoch = 0;
+    p->heap_index = -1;
+    p->ready_seq = 0;
+    p->sched_key = 0;
+
+    p->state = NEW;
+    p->next = NULL;
+    p->prev = NULL;
+}
+
+void resetProcesses()
+{
+    initQueue(&terminatedQ);
+    for (int i = 0; i < procCount; i++)
+    {
+        resetPCB(pcbAt(i));
+    }
+}
+
+void chargeCPU(CPU *cpu, PCB *p, int time)
+{
+    int ran = time - p->run_start;
+    p->executed_time += ran;
+    p->cpu_remaining -= ran;
+    p->burst_left -= ran;
+    p->run_start = time;
+    cpu->busy += ran;
+}
+
+/* A process dispatched with no burst left never gives up the CPU, as in the old tick loop. */
+void scheduleCPUEvent(PCB *p, int time, int slice)
+{
+    int len = p->burst_left;
+    if (len <= 0)
+    {
+        return;
+    }
+    if (slice > 0 && slice < len)
+    {
+        len = slice;
+    }
+
+    Event ev = {time + len, EV_CPU, ++dispatchSeq, p->pid, p};
+    p->event_seq = ev.seq;
+    heapPush(&events, ev);
+}
+
+void dispatch(CPU *cpu, PCB *p, int now)
+{
+    if (p->cpu >= 0 && p->cpu != cpu->id)
+    {
+        cpu->migrations++;
+    }
+    p->cpu = cpu->id;
+    setState(p, RUNNING, now);
+    p->run_start = now;
+    if (p->first_run < 0)
+    {
+        p->first_run = now;
+    }
+
+    cpu->running = p;
+    cpu->dispatches++;
+    scheduleCPUEvent(p, now, schedSlice(&cpu->sched, p));
+}
+
+/* An idle CPU with an empty run queue takes the next process from the longest other queue. */
+PCB *stealWork(Machine *m, CPU *thief, int now)
+{
+    CPU *victim = NULL;
+
+    for (int i = 0; i < m->count; i++)
+    {
+        CPU *c = &m->cpus[i];
+        if (c != thief && c->sched.count > 0 && (!victim || c->sched.count > victim->sched.count))
+        {
+            victim = c;
+        }
+    }
+    if (!victim)
+    {
+        return NULL;
+    }
+
+    thief->steals++;
+    return schedPick(&victim->sched, now);
+}
+
+void handleCPUEvent(Machine *m, Event *ev, int *terminated)
+{
+    PCB *p = ev->process;
+    CPU *cpu = &m->cpus[p->cpu];
+    if (p != cpu->running || p->event_seq != ev->seq)
+    {
+        return;
+    }
+
+    chargeCPU(cpu, p, ev->time);
+    cpu->running = NULL;
+
+    if (p->cpu_remaining == 0)
+    {
+        terminatePCB(p, ev->time);
+        (*terminated)++;
+    }
+    else if (p->burst_left == 0)
+    {
+        p->io_remaining = p->bursts[p->burst_index + 1];
+        p->io_due = ev->time + p->io_remaining;
+        p->burst_index += 2;
+        p->burst_left = p->bursts[p->burst_index];
+        p->event_seq = ioSeq++;
+        setState(p, WAITING, ev->time);
+        ioWheelAdd(&ioWheel, p);
+    }
+    else
+    {
+        schedExpired(&cpu->sched, p, ev->time);
+        setState(p, READY, ev->time);
+        schedAdd(&cpu->sched, p, ev->time);
+    }
+}
+
+void terminatePCB(PCB *p, int time)
+{
+    setState(p, TERMINATED, time);
+    p->completion_time = time;
+    enqueue(&terminatedQ, p);
+}
+
+/* A process that has not arrived yet does not exist as far as KILL is concerned. */
+void applyKillEvent(Machine *m, Event *kill, int *terminated)
+{
+    PCB *target = hashGet(kill->pid);
+    if (!target || target->state == NEW || target->state == TERMINATED)
+    {
+        return;
+    }
+
+    CPU *cpu = &m->cpus[target->cpu];
+    if (target == cpu->running)
+    {
+        chargeCPU(cpu, target, kill->time);
+        cpu->running = NULL;
+    }
+    else if (target->state == READY)
+    {
+        schedRemove(&cpu->sched, target);
+    }
+    else
+    {
+        ioWheelRemove(&ioWheel, target);
+    }
+
+    target->killed = 1;
+    target->killed_time = kill->time;
+    terminatePCB(target, kill->time);
+    (*terminated)++;
+}
+
+int initMachine(Machine *m, const SimConfig *cfg)
+{
+    m->count = cfg->cpus;
+    m->makespan = 0;
+    m->cpus = (CPU *)calloc(m->count, sizeof(CPU));
+    if (!m->cpus)
+    {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+
+    for (int i = 0; i < m->count; i++)
+    {
+        m->cpus[i].id = i;
+        initScheduler(&m->cpus[i].sched, cfg->policy, cfg->quantum, cfg->aging, cfg->boost);
+    }
+    return 1;
+}
+
+void freeMachine(Machine *m)
+{
+    for (int i = 0; i < m->count; i++)
+    {
+        freeScheduler(&m->cpus[i].sched);
+    }
+    free(m->cpus);
+    m->cpus = NULL;
+    m->count = 0;
+}
+
+/*
+ * Jumps from one event time to the next instead of ticking. Events at the same
+ * instant are applied in the order the tick loop produced them: a running
+ * process's burst end, IO start or quantum expiry, then IO completions in the
+ * order they blocked, then arrivals, then due KILL lines in input order. Only
+ * then may a policy
+ * preempt, does each idle CPU take from its own run queue, and finally do the
+ * CPUs that are still idle steal from the others.
+ *
+ * Arriving processes are spread round-robin over the CPUs; a process coming
+ * back from IO or losing the CPU is queued on the CPU it last ran on.
+ */
+int simulate(Machine *m)
+{
+    int terminated = 0;
+    int now = 0;
+    int nextAdmit = 0;
+    int killFed = 0;
+
+    events.size = 0;
+    kills.size = 0;
+    resetIOWheel(&ioWheel);
+    ioSeq = 0;
+    dispatchSeq = 0;
+
+    while (1)
+    {
+        ioWheelAdvance(&ioWheel, now);
+        while (events.size > 0 && events.items[0].time == now)
+        {
+            Event ev = heapPop(&events);
+            handleCPUEvent(m, &ev, &terminated);
+        }
+        fireIOCompletions(m, now);
+        feedTrace(m, now, &nextAdmit, &killFed);
+        while (kills.size > 0 && kills.items[0].time == now)
+        {
+            Event kill = heapPop(&kills);
+            applyKillEvent(m, &kill, &terminated);
+        }
+
+        for (int i = 0; i < m->count; i++)
+        {
+            CPU *cpu = &m->cpus[i];
+            PCB *running = cpu->running;
+            if (running)
+            {
+                chargeCPU(cpu, running, now);
+                if (schedPreempts(&cpu->sched, running, now))
+                {
+                    running->event_seq = -1;
+                    setState(running, READY, now);
+                    schedAdd(&cpu->sched, running, now);
+                    cpu->running = NULL;
+                }
+            }
+        }
+
+        for (int i = 0; i < m->count; i++)
+        {
+            CPU *cpu = &m->cpus[i];
+            PCB *next;
+            if (!cpu->running && (next = schedPick(&cpu->sched, now)))
+            {
+                dispatch(cpu, next, now);
+            }
+        }
+
+        for (int i = 0; i < m->count; i++)
+        {
+            CPU *cpu = &m->cpus[i];
+            PCB *next;
+            if (!cpu->running && (next = stealWork(m, cpu, now)))
+            {
+                dispatch(cpu, next, now);
+            }
+        }
+
+        if (terminated == procCount && nextAdmit == procCount && traceDone)
+        {
+            break;
+        }
+        int next = events.size > 0 ? events.items[0].time : INT_MAX;
+        int ioNext = ioWheelNext(&ioWheel);
+        if (ioNext < next)
+        {
+            next = ioNext;
+        }
+        if (kills.size > 0 && kills.items[0].time < next)
+        {
+            next = kills.items[0].time;
+        }
+        if (nextAdmit < procCount && pcbAt(nextAdmit)->arrival < next)
+        {
+            next = pcbAt(nextAdmit)->arrival;
+        }
+
+        if (next == INT_MAX)
+        {
+            for (int i = 0; i < m->count; i++)
+            {
+                if (m->cpus[i].running)
+                {
+                    printf("Simulation stalled: PID %d never finishes its burst.\n", m->cpus[i].running->pid);
+                    break;
+                }
+            }
+            return 0;
+        }
+        now = next;
+    }
+
+    m->makespan = now;
+    return 1;
+}
+
+int cmpPID(const void *a, const void *b)
+{
+    PCB *p1 = *(PCB **)a;
+    PCB *p2 = *(PCB **)b;
+    return (p1->pid > p2->pid) - (p1->pid < p2->pid);
+}
+
+void outFlush()
+{
+    fwrite(outBuf, 1, outLen, stdout);
+    outLen = 0;
+}
+
+void outBytes(const void *data, size_t len)
+{
+    if (outLen + len > OUT_BUF_SIZE)
+    {
+        outFlush();
+    }
+    if (len > OUT_BUF_SIZE)
+    {
+        fwrite(data, 1, len, stdout);
+        return;
+    }
+    memcpy(outBuf + outLen, data, len);
+    outLen += len;
+}
+
+void outStr(const char *str)
+{
+    while (*str)
+    {
+        if (outLen == OUT_BUF_SIZE)
+        {
+            outFlush();
+        }
+        outBuf[outLen++] = *str++;
+    }
+}
+
+int formatInt(char *dst, long long value)
+{
+    char digits[24];
+    int n = 0, len = 0;
+    unsigned long long v = value < 0 ? -(unsigned long long)value : (unsigned long long)value;
+
+    do
+    {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0)
+    {
+        digits[n++] = '-';
+    }
+
+    while (n > 0)
+    {
+        dst[len++] = digits[--n];
+    }
+    return len;
+}
+
+void outInt(long long value)
+{
+    if (outLen + 24 > OUT_BUF_SIZE)
+    {
+        outFlush();
+    }
+    outLen += formatInt(outBuf + outLen, value);
+}
+
+void outRowPrefix(PCB *p)
+{
+    outInt(p->pid);
+    outStr("\t");
+    outStr(p->name);
+    outStr("\t");
+    outInt(p->cpu_burst);
+    outStr("\t");
+    outInt(p->io_time_total);
+    outStr("\t");
+}
+
+/*
+ * Rows are formatted straight into a large output buffer. Input that is
+ * already in PID order, the usual case for generated traces, is written
+ * without building and sorting a pointer array.
+ */
+void printResults()
+{
+    PCB **arr = NULL;
+    int n = procCount;
+    int anyKilled = 0;
+    int sorted = 1;
+
+    for (int i = 0; i < n; i++)
+    {
+        PCB *p = pcbAt(i);
+        if (p->killed)
+        {
+            anyKilled = 1;
+        }
+        if (i > 0 && pcbAt(i - 1)->pid > p->pid)
+        {
+            sorted = 0;
+        }
+    }
+
+    if (!sorted)
+    {
+        arr = (PCB **)malloc(n * sizeof(PCB *));
+        if (!arr)
+        {
+            printf("Memory allocation failed\n");
+            return;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            arr[i] = pcbAt(i);
+        }
+        qsort(arr, n, sizeof(PCB *), cmpPID);
+    }
+
+    fflush(stdout);
+    if (!anyKilled)
+    {
+        outStr("PID\tName\tCPU\tIO\tTurnaround\tWaiting\n");
+        for (int i = 0; i < n; i++)
+        {
+            PCB *p = arr ? arr[i] : pcbAt(i);
+            int tat = p->completion_time - p->arrival;
+            outRowPrefix(p);
+            outInt(tat);
+            outStr("\t\t");
+            outInt(tat - p->cpu_burst);
+            outStr("\n");
+        }
+    }
+    else
+    {
+        outStr("PID\tName\tCPU\tIO\tStatus\t\tTurnaround\tWaiting\n");
+        for (int i = 0; i < n; i++)
+        {
+            PCB *p = arr ? arr[i] : pcbAt(i);
+            outRowPrefix(p);
+            if (p->killed)
+            {
+                outStr("KILLED at ");
+                outInt(p->killed_time);
+                outStr("\t-\t\t-\n");
+            }
+            else
+            {
+                int tat = p->completion_time - p->arrival;
+                outStr("OK\t\t");
+                outInt(tat);
+                outStr("\t\t");
+                outInt(tat - p->cpu_burst);
+                outStr("\n");
+            }
+        }
+    }
+    outFlush();
+    fflush(stdout);
+    free(arr);
+}
+
+void printCPUStats(Machine *m)
+{
+    printf("\nCPU\tBusy\tUtilization\tDispatches\tMigrations\tSteals\n");
+    for (int i = 0; i < m->count; i++)
+    {
+        CPU *cpu = &m->cpus[i];
+        double util = m->makespan > 0 ? 100.0 * cpu->busy / m->makespan : 0.0;
+        printf("%d\t%lld\t%.2f%%\t\t%d\t\t%d\t\t%d\n", cpu->id, cpu->busy, util, cpu->dispatches, cpu->migrations, cpu->steals);
+    }
+    printf("Load imbalance (max/avg busy): %.2f\n", loadImbalance(m));
+}
+
+double loadImbalance(Machine *m)
+{
+    long long total = 0, max = 0;
+
+    for (int i = 0; i < m->count; i++)
+    {
+        total += m->cpus[i].busy;
+        if (m->cpus[i].busy > max)
+        {
+            max = m->cpus[i].busy;
+        }
+    }
+    return total > 0 ? (double)max * m->count / total : 1.0;
+}
+
+void summarize(Machine *m, RunSummary *sum)
+{
+    long long tatSum = 0, waitSum = 0, respSum = 0, busy = 0;
+    int *waits = (int *)malloc((procCount > 0 ? procCount : 1) * sizeof(int));
+
+    memset(sum, 0, sizeof(*sum));
+    sum->makespan = m->makespan;
+    sum->imbalance = loadImbalance(m);
+    for (int i = 0; i < m->count; i++)
+    {
+        sum->dispatches += m->cpus[i].dispatches;
+        sum->migrations += m->cpus[i].migrations;
+        busy += m->cpus[i].busy;
+    }
+
+    for (int i = 0; i < procCount; i++)
+    {
+        PCB *p = pcbAt(i);
+        if (p->killed)
+        {
+            sum->killed++;
+            continue;
+        }
+        int tat = p->completion_time - p->arrival;
+        if (waits)
+        {
+            waits[sum->completed] = tat - p->cpu_burst;
+        }
+        sum->completed++;
+        tatSum += tat;
+        waitSum += tat - p->cpu_burst;
+        respSum += p->first_run - p->arrival;
+    }
+
+    if (sum->completed > 0)
+    {
+        sum->avgTurnaround = (double)tatSum / sum->completed;
+        sum->avgWaiting = (double)waitSum / sum->completed;
+        sum->avgResponse = (double)respSum / sum->completed;
+    }
+    if (sum->makespan > 0)
+    {
+        sum->throughput = (double)sum->completed / sum->makespan;
+        sum->utilization = 100.0 * busy / ((double)sum->makespan * m->count);
+    }
+    if (waits && sum->completed > 0)
+    {
+        qsort(waits, sum->completed, sizeof(int), cmpInt);
+        sum->waitP50 = percentile(waits, sum->completed, 50);
+        sum->waitP90 = percentile(waits, sum->completed, 90);
+        sum->waitP99 = percentile(waits, sum->completed, 99);
+        sum->waitMax = waits[sum->completed - 1];
+    }
+    free(waits);
+}
+
+int cmpInt(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of an ascending array. */
+int percentile(const int *sorted, int n, int pct)
+{
+    int rank = (int)(((long long)pct * n + 99) / 100);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void printMetrics(Machine *m)
+{
+    RunSummary sum;
+
+    summarize(m, &sum);
+    printf("\nCompleted: %d  Killed: %d  Makespan: %d\n", sum.completed, sum.killed, sum.makespan);
+    printf("Throughput: %.4f processes/unit\n", sum.throughput);
+    printf("CPU utilization: %.2f%%\n", sum.utilization);
+    printf("Average turnaround: %.2f  waiting: %.2f  response: %.2f\n", sum.avgTurnaround, sum.avgWaiting, sum.avgResponse);
+    printf("Waiting p50: %d  p90: %d  p99: %d  max: %d\n", sum.waitP50, sum.waitP90, sum.waitP99, sum.waitMax);
+}
+
+/*
+ * Every state change is appended to an in-memory buffer that is written out
+ * only when full, so a run without a timeline pays one branch per change.
+ * CSV rows are time,pid,cpu,state; binary records follow TIMELINE_MAGIC as
+ * int32 time, int32 pid, int16 cpu and a uint8 State, in host byte order.
+ */
+int openTimeline(const char *path, int binary)
+{
+    timeline.fp = fopen(path, binary ? "wb" : "w");
+    if (!timeline.fp)
+    {
+        printf("Cannot open timeline file %s\n", path);
+        return 0;
+    }
+    timeline.buf = (char *)malloc(OUT_BUF_SIZE);
+    if (!timeline.buf)
+    {
+        printf("Memory allocation failed\n");
+        fclose(timeline.fp);
+        timeline.fp = NULL;
+        return 0;
+    }
+    timeline.binary = binary;
+    timeline.len = 0;
+
+    if (binary)
+    {
+        memcpy(timeline.buf, TIMELINE_MAGIC, 8);
+        timeline.len = 8;
+    }
+    else
+    {
+        timeline.len = sprintf(timeline.buf, "time,pid,cpu,state\n");
+    }
+    return 1;
+}
+
+void timelineFlush()
+{
+    fwrite(timeline.buf, 1, timeline.len, timeline.fp);
+    timeline.len = 0;
+}
+
+void closeTimeline()
+{
+    if (!timeline.fp)
+    {
+        return;
+    }
+    timelineFlush();
+    fclose(timeline.fp);
+    free(timeline.buf);
+    timeline.fp = NULL;
+    timeline.buf = NULL;
+}
+
+void setState(PCB *p, State state, int now)
+{
+    p->state = state;
+    if (!timeline.fp)
+    {
+        return;
+    }
+
+    if (timeline.len + 64 > OUT_BUF_SIZE)
+    {
+        timelineFlush();
+    }
+
+    char *dst = timeline.buf + timeline.len;
+    if (timeline.binary)
+    {
+        int32_t time = now, pid = p->pid;
+        int16_t cpu = (int16_t)p->cpu;
+        unsigned char st = (unsigned char)state;
+        memcpy(dst, &time, 4);
+        memcpy(dst + 4, &pid, 4);
+        memcpy(dst + 8, &cpu, 2);
+        memcpy(dst + 10, &st, 1);
+        timeline.len += TIMELINE_RECORD_SIZE;
+    }
+    else
+    {
+        const char *name = stateNames[state];
+        size_t nameLen = strlen(name);
+        dst += formatInt(dst, now);
+        *dst++ = ',';
+        dst += formatInt(dst, p->pid);
+        *dst++ = ',';
+        dst += formatInt(dst, p->cpu);
+        *dst++ = ',';
+        memcpy(dst, name, nameLen);
+        dst[nameLen] = '\n';
+        timeline.len = dst + nameLen + 1 - timeline.buf;
+    }
+}
+
+void printComparison(const SimConfig *cfg)
+{
+    printf("Policy\t\tDone\tKilled\tAvgTurnaround\tAvgWaiting\tAvgResponse\tMakespan\tDispatches\tMigrations\tImbalance\n");
+
+    for (int policy = 0; policy < POLICY_COUNT; policy++)
+    {
+        SimConfig run = *cfg;
+        Machine machine;
+        RunSummary sum;
+
+        run.policy = (Policy)policy;
+        resetProcesses();
+        if (!initMachine(&machine, &run))
+        {
+            return;
+        }
+        if (!simulate(&machine))
+        {
+            printf("%-8s\tstalled\n", policyNames[policy]);
+            freeMachine(&machine);
+            continue;
+        }
+
+        summarize(&machine, &sum);
+        printf("%-8s\t%d\t%d\t%.2f\t\t%.2f\t\t%.2f\t\t%d\t\t%d\t\t%d\t\t%.2f\n", policyNames[policy], sum.completed, sum.killed,
+               sum.avgTurnaround, sum.avgWaiting, sum.avgResponse, sum.makespan, sum.dispatches, sum.migrations, sum.imbalance);
+        freeMachine(&machine);
+    }
+}
+
+/* Comma-separated integers, each at least min; returns how many, or 0 if any is invalid. */
+int parseIntList(const char *list, int *values, int min)
+{
+    int count = 0;
+    const char *cur = list;
+
+    while (1)
+    {
+        char *end;
+        long value = strtol(cur, &end, 10);
+        if (end == cur || value < min || value > INT_MAX || count == SWEEP_MAX_VALUES)
+        {
+            return 0;
+        }
+        values[count++] = (int)value;
+        if (*end == '\0')
+        {
+            return count;
+        }
+        if (*end != ',')
+        {
+            return 0;
+        }
+        cur = end + 1;
+    }
+}
+
+int parsePolicyList(const char *list, Policy *values)
+{
+    int count = 0;
+    const char *cur = list;
+
+    while (1)
+    {
+        char name[16];
+        size_t len = strcspn(cur, ",");
+        if (len == 0 || len >= sizeof(name) || count == POLICY_COUNT)
+        {
+            return 0;
+        }
+        memcpy(name, cur, len);
+        name[len] = '\0';
+        if (!parsePolicy(name, &values[count++]))
+        {
+            return 0;
+        }
+        if (cur[len] == '\0')
+        {
+            return count;
+        }
+        cur += len + 1;
+    }
+}
+
+int copyPool(const PCBPool *src)
+{
+    pcbPool.chunks = (PCB **)malloc((src->chunkCount > 0 ? src->chunkCount : 1) * sizeof(PCB *));
+    if (!pcbPool.chunks)
+    {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    pcbPool.chunkCapacity = src->chunkCount;
+    pcbPool.chunkCount = 0;
+
+    for (int c = 0; c < src->chunkCount; c++)
+    {
+        int used = procCount - c * PCB_CHUNK_SIZE;
+        if (used > PCB_CHUNK_SIZE)
+        {
+            used = PCB_CHUNK_SIZE;
+        }
+        PCB *chunk = (PCB *)malloc(PCB_CHUNK_SIZE * sizeof(PCB));
+        if (!chunk)
+        {
+            printf("Memory allocation failed\n");
+            return 0;
+        }
+        memcpy(chunk, src->chunks[c], used * sizeof(PCB));
+        pcbPool.chunks[pcbPool.chunkCount++] = chunk;
+    }
+    return 1;
+}
+
+void freeRunState()
+{
+    for (int c = 0; c < pcbPool.chunkCount; c++)
+    {
+        free(pcbPool.chunks[c]);
+    }
+    free(pcbPool.chunks);
+    free(events.items);
+    free(kills.items);
+    free(ioWheel.overflow.items);
+    memset(&pcbPool, 0, sizeof(pcbPool));
+    memset(&events, 0, sizeof(events));
+    memset(&kills, 0, sizeof(kills));
+    memset(&ioWheel.overflow, 0, sizeof(ioWheel.overflow));
+}
+
+void *sweepWorker(void *arg)
+{
+    Sweep *sw = (Sweep *)arg;
+    int ready = copyPool(sw->trace);
+
+    while (1)
+    {
+        pthread_mutex_lock(&sw->lock);
+        int i = sw->next++;
+        pthread_mutex_unlock(&sw->lock);
+        if (i >= sw->count)
+        {
+            break;
+        }
+
+        SweepRun *run = &sw->runs[i];
+        Machine machine;
+        if (!ready || !initMachine(&machine, &run->cfg))
+        {
+            continue;
+        }
+        resetProcesses();
+        if (simulate(&machine))
+        {
+            summarize(&machine, &run->sum);
+            run->status = 1;
+        }
+        else
+        {
+            run->status = 0;
+        }
+        freeMachine(&machine);
+    }
+
+    freeRunState();
+    return NULL;
+}
+
+/*
+ * Runs every combination of the given policies, quanta and CPU counts over the
+ * already parsed trace, spread over a pool of threads, and prints one row per
+ * run in the order the combinations were listed. Policies without a time slice
+ * are run once per CPU count rather than once per quantum.
+ */
+int runSweep(const SimConfig *cfg, const Policy *policies, int policyCount, const int *quanta, int quantumCount,
+             const int *cpuCounts, int cpuCountCount, int threads)
+{
+    Sweep sw;
+    sw.runs = (SweepRun *)malloc(policyCount * quantumCount * cpuCountCount * sizeof(SweepRun));
+    if (!sw.runs)
+    {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    sw.count = 0;
+    sw.next = 0;
+    sw.trace = &pcbPool;
+    pthread_mutex_init(&sw.lock, NULL);
+
+    for (int p = 0; p < policyCount; p++)
+    {
+        int sliced = policies[p] == POLICY_RR || policies[p] == POLICY_MLFQ;
+        for (int q = 0; q < (sliced ? quantumCount : 1); q++)
+        {
+            for (int c = 0; c < cpuCountCount; c++)
+            {
+                SweepRun *run = &sw.runs[sw.count++];
+                run->cfg = *cfg;
+                run->cfg.policy = policies[p];
+                run->cfg.quantum = quanta[q];
+                run->cfg.cpus = cpuCounts[c];
+                run->status = -1;
+            }
+        }
+    }
+
+    if (threads > sw.count)
+    {
+        threads = sw.count;
+    }
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (!ids)
+    {
+        printf("Memory allocation failed\n");
+        pthread_mutex_destroy(&sw.lock);
+        free(sw.runs);
+        return 0;
+    }
+
+    int started = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&ids[started], NULL, sweepWorker, &sw) == 0)
+        {
+            started++;
+        }
+    }
+    if (started == 0)
+    {
+        sweepWorker(&sw);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+
+    printf("Policy\t\tQuantum\tCPUs\tDone\tKilled\tAvgTurnaround\tAvgWaiting\tAvgResponse\tP90Wait\tMakespan\tThroughput\tUtilization\n");
+    for (int i = 0; i < sw.count; i++)
+    {
+        SweepRun *run = &sw.runs[i];
+        int sliced = run->cfg.policy == POLICY_RR || run->cfg.policy == POLICY_MLFQ;
+
+        printf("%-8s\t", policyNames[run->cfg.policy]);
+        if (sliced)
+        {
+            printf("%d\t", run->cfg.quantum);
+        }
+        else
+        {
+            printf("-\t");
+        }
+        printf("%d\t", run->cfg.cpus);
+
+        if (run->status < 0)
+        {
+            printf("failed\n");
+            continue;
+        }
+        if (run->status == 0)
+        {
+            printf("stalled\n");
+            continue;
+        }
+        RunSummary *sum = &run->sum;
+        printf("%d\t%d\t%.2f\t\t%.2f\t\t%.2f\t\t%d\t%d\t\t%.4f\t\t%.2f%%\n", sum->completed, sum->killed, sum->avgTurnaround,
+               sum->avgWaiting, sum->avgResponse, sum->waitP90, sum->makespan, sum->throughput, sum->utilization);
+    }
+
+    pthread_mutex_destroy(&sw.lock);
+    free(ids);
+    free(sw.runs);
+    return 1;
+}
+
+long long elapsedMs(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000LL + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Child side of real mode, started as "burn=tick_ms,fd,cpu0,cpu1,...". It
+ * stops itself until first dispatched, then spins until its own CPU clock has
+ * used each CPU burst. Between bursts it reports the burst on fd and stops
+ * again; the parent keeps it stopped for the IO time and continues it when
+ * the scheduler picks it.
+ */
+int burnProcess(const char *args)
+{
+    char *end;
+    long tickMs = strtol(args, &end, 10);
+    int fd = (int)strtol(end + 1, &end, 10);
+    long long target = 0;
+    int burst = 0;
+
+    raise(SIGSTOP);
+    while (*end == ',')
+    {
+        if (burst > 0)
+        {
+            BurstMsg msg = {getpid(), burst - 1};
+            if (write(fd, &msg, sizeof(msg)) != sizeof(msg))
+            {
+                return 1;
+            }
+            raise(SIGSTOP);
+        }
+
+        target += strtol(end + 1, &end, 10) * tickMs * 1000000LL;
+        struct timespec used;
+        do
+        {
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &used);
+        } while (used.tv_sec * 1000000000LL + used.tv_nsec < target);
+        burst++;
+    }
+    return 0;
+}
+
+/* Real mode runs a handful of actual processes, so plain scans are enough. */
+RealProc *realByPid(RealProc *real, pid_t pid)
+{
+    for (int i = 0; i < procCount; i++)
+    {
+        if (real[i].pid == pid)
+        {
+            return &real[i];
+        }
+    }
+    return NULL;
+}
+
+RealProc *realByPCB(RealProc *real, PCB *p)
+{
+    for (int i = 0; i < procCount; i++)
+    {
+        if (real[i].p == p)
+        {
+            return &real[i];
+        }
+    }
+    return NULL;
+}
+
+int spawnReal(RealProc *r, int tickMs, int msgFd, const sigset_t *origMask)
+{
+    PCB *p = r->p;
+    size_t cap = 32 + (size_t)p->burst_count * 12;
+    char *arg = (char *)malloc(cap);
+    if (!arg)
+    {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+
+    int len = snprintf(arg, cap, "burn=%d,%d", tickMs, msgFd);
+    for (int i = 0; i < p->burst_count; i += 2)
+    {
+        len += snprintf(arg + len, cap - len, ",%d", p->bursts[i]);
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        sigprocmask(SIG_SETMASK, origMask, NULL);
+        execl("/proc/self/exe", "FCFS_OS", arg, (char *)NULL);
+        _exit(127);
+    }
+    free(arg);
+    if (pid < 0)
+    {
+        printf("Cannot start process for PID %d\n", p->pid);
+        return 0;
+    }
+
+    int status;
+    r->pid = pid;
+    if (waitpid(pid, &status, WUNTRACED) != pid || !WIFSTOPPED(status))
+    {
+        printf("Cannot start process for PID %d\n", p->pid);
+        r->pid = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void drainBurstMessages(RealProc *real, int fd)
+{
+    BurstMsg msg;
+
+    while (read(fd, &msg, sizeof(msg)) == sizeof(msg))
+    {
+        RealProc *r = realByPid(real, msg.pid);
+        if (r)
+        {
+            r->burstDone = 1;
+        }
+    }
+}
+
+/* Takes the running process off the CPU, charging whole ticks of what it ran. */
+void stopReal(Scheduler *s, RealProc *r, long long t, int tickMs, int expired)
+{
+    PCB *p = r->p;
+    int ran = (int)((t - r->runStart) / tickMs);
+
+    if (ran >= p->burst_left)
+    {
+        ran = p->burst_left - 1;
+    }
+    p->burst_left -= ran;
+    p->cpu_remaining -= ran;
+    p->executed_time += ran;
+
+    kill(r->pid, SIGSTOP);
+    r->stopsSent++;
+    if (expired)
+    {
+        schedExpired(s, p, (int)(t / tickMs));
+    }
+    setState(p, READY, (int)(t / tickMs));
+    schedAdd(s, p, (int)(t / tickMs));
+}
+
+void finishBurst(Scheduler *s, RealProc *r, long long t, int tickMs)
+{
+    PCB *p = r->p;
+
+    if (p->state == READY)
+    {
+        schedRemove(s, p);
+    }
+    p->cpu_remaining -= p->burst_left;
+    p->executed_time += p->burst_left;
+    r->ioDue = t + (long long)p->bursts[p->burst_index + 1] * tickMs;
+    p->burst_index += 2;
+    p->burst_left = p->bursts[p->burst_index];
+    setState(p, WAITING, (int)(t / tickMs));
+}
+
+void printRealResults(RealProc *real, int tickMs)
+{
+    double errSum = 0;
+    int measured = 0;
+
+    printf("PID\tName\tPredTurnaround\tRealTurnaround\tPredWaiting\tRealWaiting\t(ticks of %d ms)\n", tickMs);
+    for (int i = 0; i < procCount; i++)
+    {
+        RealProc *r = &real[i];
+        PCB *p = r->p;
+        if (p->killed)
+        {
+            printf("%d\t%s\tKILLED at %d\n", p->pid, p->name, p->killed_time);
+            continue;
+        }
+
+        double tat = (double)(r->finish - (long long)p->arrival * tickMs) / tickMs;
+        printf("%d\t%s\t%d\t\t%.2f\t\t%d\t\t%.2f\n", p->pid, p->name, r->predTurnaround, tat, r->predWaiting,
+               tat - p->cpu_burst);
+        errSum += tat > r->predTurnaround ? tat - r->predTurnaround : r->predTurnaround - tat;
+        measured++;
+    }
+    if (measured > 0)
+    {
+        printf("Mean turnaround error: %.2f ticks\n", errSum / measured);
+    }
+}
+
+/*
+ * Replays the trace with real child processes on one CPU. The scheduler makes
+ * the same decisions as in the simulation, enforced with SIGSTOP/SIGCONT, and
+ * the measured turnaround and waiting times are printed next to the simulated
+ * ones. Children report the end of a CPU burst on a pipe before stopping
+ * themselves, and that pipe is drained before each stop is interpreted so a
+ * burst ending and a preemption at the same moment are told apart. A slice
+ * is only enforced while the burst outlasts it; otherwise the child's own CPU
+ * clock decides, as a burst end does in the simulation.
+ */
+int runReal(const SimConfig *cfg, int tickMs)
+{
+    RealProc *real = (RealProc *)calloc(procCount, sizeof(RealProc));
+    Machine machine;
+    int msgPipe[2];
+    sigset_t mask, origMask;
+
+    if (!real)
+    {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    if (!initMachine(&machine, cfg))
+    {
+        free(real);
+        return 0;
+    }
+    if (!simulate(&machine))
+    {
+        freeMachine(&machine);
+        free(real);
+        return 0;
+    }
+    for (int i = 0; i < procCount; i++)
+    {
+        PCB *p = pcbAt(i);
+        real[i].p = p;
+        real[i].predTurnaround = p->completion_time - p->arrival;
+        real[i].predWaiting = real[i].predTurnaround - p->cpu_burst;
+    }
+    freeMachine(&machine);
+
+    if (pipe(msgPipe) < 0 || !initMachine(&machine, cfg))
+    {
+        printf("Cannot set up real mode\n");
+        free(real);
+        return 0;
+    }
+    fcntl(msgPipe[0], F_SETFL, O_NONBLOCK);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &origMask);
+
+    resetProcesses();
+    kills.size = 0;
+    for (int i = 0; i < killCount; i++)
+    {
+        Event ev = {killList[i].time, EV_KILL, killList[i].seq, killList[i].pid, NULL};
+        heapPush(&kills, ev);
+    }
+
+    Scheduler *s = &machine.cpus[0].sched;
+    RealProc *running = NULL;
+    int nextArrival = 0;
+    int remaining = procCount;
+    int ok = 1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (remaining > 0)
+    {
+        long long t = elapsedMs(&start);
+        int tick = (int)(t / tickMs);
+        int status;
+        pid_t pid;
+
+        while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0)
+        {
+            RealProc *r = realByPid(real, pid);
+            if (!r || r->p->state == TERMINATED)
+            {
+                continue;
+            }
+            PCB *p = r->p;
+
+            if (WIFEXITED(status) || WIFSIGNALED(status))
+            {
+                if (p->state == READY)
+                {
+                    schedRemove(s, p);
+                }
+                if (r == running)
+                {
+                    running = NULL;
+                }
+                p->executed_time = p->cpu_burst;
+                p->cpu_remaining = 0;
+                r->finish = t;
+                terminatePCB(p, tick);
+                remaining--;
+                continue;
+            }
+
+            drainBurstMessages(real, msgPipe[0]);
+            r->stopsSent = 0;
+            if (r->burstDone)
+            {
+                r->burstDone = 0;
+                if (r == running)
+                {
+                    running = NULL;
+                }
+                finishBurst(s, r, t, tickMs);
+            }
+            else if (r == running)
+            {
+                kill(pid, SIGCONT);
+            }
+        }
+
+        for (int i = 0; i < nextArrival; i++)
+        {
+            if (real[i].p->state == WAITING && real[i].ioDue <= t)
+            {
+                setState(real[i].p, READY, tick);
+                schedAdd(s, real[i].p, tick);
+            }
+        }
+
+        while (nextArrival < procCount && (long long)pcbAt(nextArrival)->arrival * tickMs <= t)
+        {
+            RealProc *r = &real[nextArrival++];
+            if (!spawnReal(r, tickMs, msgPipe[1], &origMask))
+            {
+                ok = 0;
+                break;
+            }
+            r->p->cpu = 0;
+            setState(r->p, READY, tick);
+            schedAdd(s, r->p, tick);
+        }
+        if (!ok)
+        {
+            break;
+        }
+
+        while (kills.size > 0 && (long long)kills.items[0].time * tickMs <= t)
+        {
+            Event ev = heapPop(&kills);
+            PCB *target = hashGet(ev.pid);
+            if (!target || target->state == NEW || target->state == TERMINATED)
+            {
+                continue;
+            }
+            RealProc *r = realByPCB(real, target);
+            kill(r->pid, SIGKILL);
+            if (target->state == READY)
+            {
+                schedRemove(s, target);
+            }
+            if (r == running)
+            {
+                running = NULL;
+            }
+            target->killed = 1;
+            target->killed_time = ev.time;
+            terminatePCB(target, ev.time);
+            remaining--;
+        }
+
+        if (running)
+        {
+            int slice = schedSlice(s, running->p);
+            if (slice > 0 && slice < running->p->burst_left && t - running->runStart >= (long long)slice * tickMs)
+            {
+                stopReal(s, running, t, tickMs, 1);
+                running = NULL;
+            }
+            else if (schedPreempts(s, running->p, tick))
+            {
+                stopReal(s, running, t, tickMs, 0);
+                running = NULL;
+            }
+        }
+
+        PCB *next;
+        if (!running && (next = schedPick(s, tick)))
+        {
+            running = realByPCB(real, next);
+            running->runStart = t;
+            if (running->firstRun == 0 && next->first_run < 0)
+            {
+                running->firstRun = t;
+                next->first_run = tick;
+            }
+            setState(next, RUNNING, tick);
+            machine.cpus[0].dispatches++;
+            kill(running->pid, SIGCONT);
+        }
+
+        long long wake = t + 1000;
+        if (nextArrival < procCount && (long long)pcbAt(nextArrival)->arrival * tickMs < wake)
+        {
+            wake = (long long)pcbAt(nextArrival)->arrival * tickMs;
+        }
+        if (kills.size > 0 && (long long)kills.items[0].time * tickMs < wake)
+        {
+            wake = (long long)kills.items[0].time * tickMs;
+        }
+        for (int i = 0; i < nextArrival; i++)
+        {
+            if (real[i].p->state == WAITING && real[i].ioDue < wake)
+            {
+                wake = real[i].ioDue;
+            }
+        }
+        if (running && schedSlice(s, running->p) > 0 && schedSlice(s, running->p) < running->p->burst_left)
+        {
+            long long sliceEnd = running->runStart + (long long)schedSlice(s, running->p) * tickMs;
+            if (sliceEnd < wake)
+            {
+                wake = sliceEnd;
+            }
+        }
+
+        if (remaining > 0 && wake > t)
+        {
+            struct timespec timeout = {(wake - t) / 1000, ((wake - t) % 1000) * 1000000};
+            sigtimedwait(&mask, NULL, &timeout);
+        }
+    }
+
+    for (int i = 0; i < nextArrival; i++)
+    {
+        if (real[i].pid > 0 && real[i].p->state != TERMINATED)
+        {
+            kill(real[i].pid, SIGKILL);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0)
+    {
+    }
+    sigprocmask(SIG_SETMASK, &origMask, NULL);
+    close(msgPipe[0]);
+    close(msgPipe[1]);
+
+    if (ok)
+    {
+        printRealResults(real, tickMs);
+    }
+    freeMachine(&machine);
+    free(real);
+    return ok;
+}
@@ -1,264 +1,3967 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
-#define HASH_MAP_SIZE 1009
+#define HASH_INITIAL_SLOTS 16
+#define HASH_MIGRATE_STEP 64
+#define HASH_TOMBSTONE ((Node*)&hashTombstone)
+#define SLAB_MIN_CHUNK 16
+#define SLAB_CLASS_COUNT 10
+#define SLAB_PAGE_SIZE (64 * 1024)
+#define SLAB_PAGE_HEADER 16
+#define NODE_INLINE_VALUE 24
+#define READ_BUFFER_STRIPES 16
+#define READ_BUFFER_SIZE 64
+#define READ_BUFFER_DRAIN_THRESHOLD 32
+#define READ_BUFFER_EMPTY INT64_MIN
+#define MAX_SHARDS 1024
+#define AUTO_SHARD_MAX 16
+#define AUTO_SHARD_MIN_ENTRIES 1024
+#define AUTO_SHARD_MIN_BYTES (64 * 1024)
+#define SKETCH_DEPTH 4
+#define SKETCH_MAX_COUNT 15
+#define SKETCH_RESET_MULTIPLIER 10
+#define NODE_BLOCK_SIZE 1024
+#define TIMER_LEVELS 5
+#define TIMER_BITS 6
+#define TIMER_BUCKETS (1 << TIMER_BITS)
+#define TIMER_UNSCHEDULED 0xff
+#define TTL_DEFAULT -1
+#define SERVER_DEFAULT_PORT 11211
+#define SERVER_MAX_EVENTS 256
+#define SERVER_MAX_LINE 4096
+#define SERVER_MAX_VALUE (1024 * 1024)
+#define SERVER_READ_CHUNK 16384
+#define SERVER_EXPIRE_INTERVAL_MS 1000
+#define MEMCACHED_RELATIVE_EXPTIME_LIMIT 2592000
+#define SNAPSHOT_MAGIC "LRUSNAP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 32
+#define SNAPSHOT_RECORD_HEADER 17
+#define SNAPSHOT_WRITE_BUFFER (1024 * 1024)
+#define SNAPSHOT_POLL_MS 100
+#define LATENCY_BUCKETS 40
+#define LATENCY_SAMPLE_BITS 4
+#define PROBE_BUCKETS 17
+#define BENCH_MAX_CAPACITIES 16
+#define BENCH_MAX_BATCH 1024
+#define BENCH_LATENCY_SUB_BITS 3
+#define BENCH_LATENCY_BUCKETS (64 << BENCH_LATENCY_SUB_BITS)
+#define BENCH_SCAN_PERIOD 3
+#define ENTRY_OVERHEAD_BYTES (sizeof(Node) + 2 * sizeof(HashSlot))
 
+typedef enum EvictionPolicy {
+    POLICY_LRU,
+    POLICY_SLRU,
+    POLICY_2Q,
+    POLICY_ARC,
+    POLICY_TINYLFU
+} EvictionPolicy;
+
+/* SEG_RECENT: LRU list, 2Q A1in, ARC T1, TinyLFU window.
+   SEG_FREQUENT: SLRU/TinyLFU protected, 2Q Am, ARC T2.
+   Ghost segments hold keys without values: 2Q A1out, ARC B1 and B2. */
+typedef enum Segment {
+    SEG_RECENT,
+    SEG_PROBATION,
+    SEG_FREQUENT,
+    SEG_GHOST_RECENT,
+    SEG_GHOST_FREQUENT,
+    SEGMENT_COUNT
+} Segment;
+
+/* Immutable once published. Owned by the cache's arena; the last holder to
+   drop a reference returns it there, even after the entry was evicted. */
+typedef struct ValueBuffer {
+    uint32_t references;
+    uint32_t length;
+    union {
+        struct ValueArena* arena;
+        struct ValueBuffer* pendingNext;
+    };
+    char data[];
+} ValueBuffer;
+
+/* Values shorter than NODE_INLINE_VALUE live in the node itself. */
 typedef struct Node {
     int key;
-    char* value;
+    uint32_t valueLength;
+    union {
+        ValueBuffer* buffer;
+        char inlineValue[NODE_INLINE_VALUE];
+    };
+    uint32_t weight;
+    uint8_t segment;
+    uint8_t timerLevel;
+    uint8_t timerBucket;
+    int64_t expiresAt;
 
     struct Node* prev;
     struct Node* next;
+    struct Node* timerPrev;
+    struct Node* timerNext;
 } Node;
 
-typedef struct HashMapNode {
+typedef struct HashSlot {
     int key;
     Node* node;
-    struct HashMapNode* next;
-} HashMapNode;
+} HashSlot;
 
-typedef struct LRUCache {
-    int capacity;
-    int size;
+typedef struct HashIndex {
+    HashSlot* slots;
+    size_t mask;
+    size_t count;
+
+    HashSlot* oldSlots;
+    size_t oldMask;
+    size_t oldCount;
+    size_t migrateCursor;
+} HashIndex;
+
+typedef struct SlabChunk {
+    struct SlabChunk* next;
+} SlabChunk;
 
+typedef struct SlabPage {
+    struct SlabPage* next;
+} SlabPage;
+
+/* Referenced by its cache and by every live ValueBuffer, so buffers held by
+   readers keep their pages alive after freeCache. Readers hand buffers back
+   through pendingFree; the owning shard recycles them on its next alloc. */
+typedef struct ValueArena {
+    SlabChunk* freeChunks[SLAB_CLASS_COUNT];
+    char* carveCursor[SLAB_CLASS_COUNT];
+    char* carveEnd[SLAB_CLASS_COUNT];
+    SlabPage* pages;
+    ValueBuffer* pendingFree;
+    long references;
+} ValueArena;
+
+typedef struct NodeBlock {
+    struct NodeBlock* next;
+    Node nodes[];
+} NodeBlock;
+
+typedef struct NodeList {
     Node* head;
     Node* tail;
+    int size;
+    size_t weight;
+} NodeList;
+
+typedef struct TimerWheel {
+    Node* buckets[TIMER_LEVELS][TIMER_BUCKETS];
+    int64_t currentTime;
+    long count;
+} TimerWheel;
+
+typedef size_t (*CacheWeigher)(int key, const char* value, size_t length, void* context);
+
+typedef struct FrequencySketch {
+    uint8_t* counters;
+    size_t widthMask;
+    long additions;
+    long resetThreshold;
+} FrequencySketch;
+
+typedef struct CacheConfig {
+    int capacity;
+    int shardCount;
+    EvictionPolicy policy;
+    size_t maxBytes;
+    CacheWeigher weigher;
+    void* weigherContext;
+    long defaultTtlMs;
+    long refreshAheadMs;
+} CacheConfig;
+
+typedef struct LRUCache {
+    size_t capacity;
+    size_t weight;
+    int size;
+    EvictionPolicy policy;
+    int byteBudget;
+    CacheWeigher weigher;
+    void* weigherContext;
 
-    HashMapNode* hashMap[HASH_MAP_SIZE];
+    NodeList lists[SEGMENT_COUNT];
+    size_t windowCapacity;
+    size_t protectedCapacity;
+    size_t ghostCapacity;
+    size_t arcTarget;
+    FrequencySketch sketch;
+    TimerWheel timers;
+    long defaultTtlMs;
+
+    long hits;
+    long misses;
+    long inserts;
+    long updates;
+    long evictions;
+    long expirations;
+
+    NodeBlock* nodeBlocks;
+    Node* freeNodes;
+    ValueArena* arena;
+
+    HashIndex index;
 } LRUCache;
 
-int hash(int key) {
-    return key % HASH_MAP_SIZE;
+typedef struct ValueHandle {
+    int length;
+    ValueBuffer* buffer;
+    int64_t expiresAt;
+    char inlineValue[NODE_INLINE_VALUE];
+} ValueHandle;
+
+/* Returns a malloc'd value (NULL when the key has none) and may set *ttlMs;
+   it is called without any cache lock held. */
+typedef char* (*CacheLoader)(int key, size_t* length, long* ttlMs, void* context);
+
+typedef struct InFlightLoad {
+    int key;
+    int done;
+    int references;
+    ValueHandle result;
+    struct InFlightLoad* next;
+} InFlightLoad;
+
+typedef struct ReadBuffer {
+    int64_t keys[READ_BUFFER_SIZE];
+    uint32_t writeCount;
+    uint32_t readCount;
+} __attribute__((aligned(64))) ReadBuffer;
+
+typedef struct CacheShard {
+    pthread_rwlock_t lock;
+    LRUCache* cache;
+    ReadBuffer readBuffers[READ_BUFFER_STRIPES];
+    pthread_mutex_t loadLock;
+    pthread_cond_t loadDone;
+    InFlightLoad* loads;
+} __attribute__((aligned(64))) CacheShard;
+
+/* Owned and written by a single thread; readers merge all blocks. Shard
+   counters are laid out as hits then misses for each shard. */
+typedef struct ThreadCounters {
+    struct ThreadCounters* next;
+    pthread_t owner;
+    uint64_t getLatency[LATENCY_BUCKETS];
+    uint64_t putLatency[LATENCY_BUCKETS];
+    uint64_t shardCounters[];
+} ThreadCounters;
+
+typedef struct ShardedCache {
+    int shardCount;
+    int shardBits;
+    CacheShard* shards;
+    uint64_t statsId;
+    pthread_mutex_t countersLock;
+    ThreadCounters* counters;
+    long refreshAheadMs;
+} ShardedCache;
+
+typedef struct ShardStats {
+    long entries;
+    size_t weight;
+    size_t capacity;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    uint64_t updates;
+    uint64_t evictions;
+    uint64_t expirations;
+} ShardStats;
+
+typedef struct CacheStats {
+    int shardCount;
+    ShardStats total;
+    ShardStats* shards;
+    uint64_t getLatency[LATENCY_BUCKETS];
+    uint64_t putLatency[LATENCY_BUCKETS];
+    uint64_t probeLengths[PROBE_BUCKETS];
+    size_t maxProbe;
+} CacheStats;
+
+typedef struct BatchPut {
+    int key;
+    const char* value;
+    size_t length;
+    long ttlMs;
+} BatchPut;
+
+typedef struct BatchScratch {
+    uint32_t* shardOf;
+    uint32_t* order;
+    size_t* hashes;
+    int* hitKeys;
+    size_t capacity;
+    uint32_t starts[MAX_SHARDS + 1];
+    uint32_t cursor[MAX_SHARDS + 1];
+} BatchScratch;
+
+typedef struct SnapshotBuffer {
+    char* data;
+    size_t length;
+    size_t capacity;
+    size_t records;
+    size_t cursor;
+} SnapshotBuffer;
+
+static const char* policyNames[] = { "lru", "slru", "2q", "arc", "tinylfu" };
+static const uint32_t sketchSeeds[SKETCH_DEPTH] = { 0x97cb3127U, 0xab7c5f1dU, 0x5a8f3e5bU, 0x2d3b4f69U };
+
+static char hashTombstone;
+static __thread int threadStripe = -1;
+static int nextThreadStripe = 0;
+static __thread BatchScratch batchScratch;
+static pthread_key_t batchScratchKey;
+static pthread_once_t batchScratchOnce = PTHREAD_ONCE_INIT;
+static __thread ThreadCounters* threadCounters;
+static __thread uint64_t threadCountersId;
+static __thread uint64_t latencySampleState;
+static uint64_t nextStatsId = 1;
+
+static inline size_t hash(int key) {
+    uint32_t h = (uint32_t)key;
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    h ^= h >> 16;
+    return h;
 }
 
-LRUCache* createCache(int capacity) {
-    LRUCache* cache = (LRUCache*)malloc(sizeof(LRUCache));
+static int slabClass(size_t size) {
+    size_t chunkSize = SLAB_MIN_CHUNK;
+    int classIndex = 0;
 
-    if(!cache) {
-        printf("Memory allocation failed\n");
-        return NULL;
+    while(chunkSize < size && classIndex < SLAB_CLASS_COUNT) {
+        chunkSize <<= 1;
+        classIndex++;
     }
+    return classIndex;
+}
 
-    cache->capacity = capacity;
-    cache->size = 0;
-    cache->head = NULL;
-    cache->tail = NULL;
+static void arenaFree(ValueArena* arena, char* value, size_t size) {
+    int classIndex = slabClass(size);
 
-    for(int index = 0; index < HASH_MAP_SIZE; index++) {
-        cache->hashMap[index] = NULL;
+    if(classIndex == SLAB_CLASS_COUNT) {
+        free(value);
+        return;
     }
 
-    return cache;
+    SlabChunk* chunk = (SlabChunk*)value;
+    chunk->next = arena->freeChunks[classIndex];
+    arena->freeChunks[classIndex] = chunk;
 }
 
-void hashPut(LRUCache* cache, int key, Node* node) {
-    int hashIndex = hash(key);
-    HashMapNode* bucket = cache->hashMap[hashIndex];
+static void arenaDrainPending(ValueArena* arena) {
+    ValueBuffer* buffer = __atomic_exchange_n(&arena->pendingFree, NULL, __ATOMIC_ACQUIRE);
 
-    while(bucket != NULL) {
-        if(bucket->key == key) {
-            bucket->node = node;
-            return;
-        }
-        bucket = bucket->next;
+    while(buffer) {
+        ValueBuffer* next = buffer->pendingNext;
+        arenaFree(arena, (char*)buffer, sizeof(ValueBuffer) + buffer->length + 1);
+        buffer = next;
     }
-
-    HashMapNode* newNode = (HashMapNode*)malloc(sizeof(HashMapNode));
-    newNode->key = key;
-    newNode->node = node;
-    newNode->next = cache->hashMap[hashIndex];
-    cache->hashMap[hashIndex] = newNode;
 }
 
-Node* hashGet(LRUCache* cache, int key) {
-    int hashIndex = hash(key);
-    HashMapNode* bucket = cache->hashMap[hashIndex];
+static char* arenaAlloc(ValueArena* arena, size_t size) {
+    int classIndex = slabClass(size);
 
-    while(bucket != NULL) {
-        if(bucket->key == key) {
-            return bucket->node;
-        }
-        bucket = bucket->next;
+    if(classIndex == SLAB_CLASS_COUNT) {
+        return (char*)malloc(size);
     }
-    return NULL;
-}
 
-void remove(LRUCache* cache, int key) {
-    int hashIndex = hash(key);
-    HashMapNode* bucket = cache->hashMap[hashIndex];
-    HashMapNode* prev = NULL;
+    if(__atomic_load_n(&arena->pendingFree, __ATOMIC_RELAXED)) {
+        arenaDrainPending(arena);
+    }
 
-    while(bucket != NULL) {
-        if(bucket->key == key) {
-            if(prev) {
-                prev->next = bucket->next;
-            } else {
-                cache->hashMap[hashIndex] = bucket->next;
-            }
+    SlabChunk* chunk = arena->freeChunks[classIndex];
+    if(chunk) {
+        arena->freeChunks[classIndex] = chunk->next;
+        return (char*)chunk;
+    }
 
-            free(bucket);
-            return;
+    size_t chunkSize = (size_t)SLAB_MIN_CHUNK << classIndex;
+    if(arena->carveCursor[classIndex] == NULL ||
+       arena->carveCursor[classIndex] + chunkSize > arena->carveEnd[classIndex]) {
+        SlabPage* page = (SlabPage*)malloc(SLAB_PAGE_SIZE);
+        if(!page) {
+            return NULL;
         }
-        prev = bucket;
-        bucket = bucket->next;
+        page->next = arena->pages;
+        arena->pages = page;
+        arena->carveCursor[classIndex] = (char*)page + SLAB_PAGE_HEADER;
+        arena->carveEnd[classIndex] = (char*)page + SLAB_PAGE_SIZE;
     }
+
+    char* value = arena->carveCursor[classIndex];
+    arena->carveCursor[classIndex] += chunkSize;
+    return value;
 }
 
-void moveToFront(LRUCache *cache, Node *node) {
-    if (node == cache->head)
+static void arenaRelease(ValueArena* arena) {
+    if(__atomic_sub_fetch(&arena->references, 1, __ATOMIC_ACQ_REL) != 0) {
         return;
+    }
 
-    if (node->prev)
-        node->prev->next = node->next;
-    else
-        cache->head = node->next; 
+    arenaDrainPending(arena);
+    SlabPage* page = arena->pages;
+    while(page) {
+        SlabPage* next = page->next;
+        free(page);
+        page = next;
+    }
+    free(arena);
+}
 
-    if (node->next)
-        node->next->prev = node->prev;
-    else
-        cache->tail = node->prev; 
+static size_t valueFootprint(size_t length) {
+    if(length < NODE_INLINE_VALUE) {
+        return 0;
+    }
 
-    node->prev = NULL;
-    node->next = cache->head;
+    size_t size = sizeof(ValueBuffer) + length + 1;
+    int classIndex = slabClass(size);
+    return classIndex < SLAB_CLASS_COUNT ? (size_t)SLAB_MIN_CHUNK << classIndex : size;
+}
 
-    if (cache->head)
-        cache->head->prev = node;
+/* owner is set when the caller holds the cache exclusively; other threads
+   queue the buffer on the arena instead of touching its free lists. */
+static void releaseBuffer(ValueBuffer* buffer, int owner) {
+    if(__atomic_sub_fetch(&buffer->references, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
 
-    cache->head = node;
+    ValueArena* arena = buffer->arena;
+    if(!arena) {
+        free(buffer);
+        return;
+    }
+    if(owner) {
+        arenaFree(arena, (char*)buffer, sizeof(ValueBuffer) + buffer->length + 1);
+    } else {
+        ValueBuffer* head = __atomic_load_n(&arena->pendingFree, __ATOMIC_RELAXED);
+        do {
+            buffer->pendingNext = head;
+        } while(!__atomic_compare_exchange_n(&arena->pendingFree, &head, buffer, 1, __ATOMIC_RELEASE,
+                                             __ATOMIC_RELAXED));
+    }
+    arenaRelease(arena);
+}
 
-    if (cache->tail == NULL)
-        cache->tail = node;
+static const char* nodeValue(const Node* node) {
+    return node->valueLength < NODE_INLINE_VALUE ? node->inlineValue : node->buffer->data;
 }
 
-void removeLRU(LRUCache* cache) {
-    if(cache->tail == NULL) {
-        return;
+static void clearValue(Node* node) {
+    if(node->valueLength >= NODE_INLINE_VALUE) {
+        releaseBuffer(node->buffer, 1);
+    }
+    node->valueLength = 0;
+    node->inlineValue[0] = '\0';
+}
+
+static int storeValue(LRUCache* cache, Node* node, const char* value, size_t length) {
+    if(length < NODE_INLINE_VALUE) {
+        clearValue(node);
+        memcpy(node->inlineValue, value, length);
+        node->inlineValue[length] = '\0';
+        node->valueLength = (uint32_t)length;
+        return 1;
+    }
+
+    ValueBuffer* buffer = (ValueBuffer*)arenaAlloc(cache->arena, sizeof(ValueBuffer) + length + 1);
+    if(!buffer) {
+        printf("Memory allocation failed\n");
+        return 0;
     }
+    buffer->references = 1;
+    buffer->length = (uint32_t)length;
+    buffer->arena = cache->arena;
+    memcpy(buffer->data, value, length);
+    buffer->data[length] = '\0';
+    __atomic_add_fetch(&cache->arena->references, 1, __ATOMIC_RELAXED);
 
-    Node* removeNode = cache->tail;
-    remove(cache, removeNode->key);
+    clearValue(node);
+    node->buffer = buffer;
+    node->valueLength = (uint32_t)length;
+    return 1;
+}
 
-    if(removeNode->prev) {
-        removeNode->prev->next = NULL;
+/* Pins the node's value into handle; the caller must hold the shard lock. */
+static void acquireValue(const Node* node, ValueHandle* handle) {
+    handle->length = (int)node->valueLength;
+    handle->expiresAt = node->expiresAt;
+    if(node->valueLength < NODE_INLINE_VALUE) {
+        handle->buffer = NULL;
+        memcpy(handle->inlineValue, node->inlineValue, node->valueLength + 1);
     } else {
-        cache->head = NULL;
+        handle->buffer = node->buffer;
+        __atomic_add_fetch(&node->buffer->references, 1, __ATOMIC_RELAXED);
     }
+}
 
-    cache->tail = removeNode->prev;
+/* Builds a handle that is not backed by any cache; large values get a
+   buffer without an arena, which is freed by its last release. */
+static int makeDetachedValue(const char* value, size_t length, ValueHandle* handle) {
+    handle->expiresAt = 0;
+    if(length < NODE_INLINE_VALUE) {
+        handle->buffer = NULL;
+        memcpy(handle->inlineValue, value, length);
+        handle->inlineValue[length] = '\0';
+        handle->length = (int)length;
+        return 1;
+    }
 
-    free(removeNode->value);
-    free(removeNode);
+    ValueBuffer* buffer = (ValueBuffer*)malloc(sizeof(ValueBuffer) + length + 1);
+    if(!buffer) {
+        printf("Memory allocation failed\n");
+        handle->buffer = NULL;
+        handle->length = -1;
+        return 0;
+    }
+    buffer->references = 1;
+    buffer->length = (uint32_t)length;
+    buffer->arena = NULL;
+    memcpy(buffer->data, value, length);
+    buffer->data[length] = '\0';
+    handle->buffer = buffer;
+    handle->length = (int)length;
+    return 1;
+}
 
-    cache->size--;
+static void copyValue(const ValueHandle* from, ValueHandle* to) {
+    *to = *from;
+    if(to->length >= 0 && to->buffer) {
+        __atomic_add_fetch(&to->buffer->references, 1, __ATOMIC_RELAXED);
+    }
 }
 
-void insertAtFront(LRUCache* cache, int key, const char* value) {
-    Node* newNode = (Node*)malloc(sizeof(Node));
-    newNode->key = key;
-    newNode->value = strdup(value);
-    newNode->next = cache->head;
-    newNode->prev = NULL;
+const char* valueData(const ValueHandle* handle) {
+    if(handle->length < 0) {
+        return NULL;
+    }
+    return handle->buffer ? handle->buffer->data : handle->inlineValue;
+}
 
-    if(cache->head) {
-        cache->head->prev = newNode;
+void releaseValue(ValueHandle* handle) {
+    if(handle->buffer) {
+        releaseBuffer(handle->buffer, 0);
+        handle->buffer = NULL;
     }
+    handle->length = -1;
+}
 
-    cache->head = newNode;
+static int growNodePool(LRUCache* cache, size_t count) {
+    NodeBlock* block = (NodeBlock*)calloc(1, sizeof(NodeBlock) + count * sizeof(Node));
+    if(!block) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
 
-    if(cache->tail == NULL) {
-        cache->tail = newNode;
+    block->next = cache->nodeBlocks;
+    cache->nodeBlocks = block;
+    for(size_t nodeIndex = count; nodeIndex > 0; nodeIndex--) {
+        block->nodes[nodeIndex - 1].next = cache->freeNodes;
+        cache->freeNodes = &block->nodes[nodeIndex - 1];
     }
+    return 1;
+}
 
-    cache->size++;
+static Node* allocateNode(LRUCache* cache) {
+    if(!cache->freeNodes && !growNodePool(cache, NODE_BLOCK_SIZE)) {
+        return NULL;
+    }
 
-    hashPut(cache, key, newNode);
+    Node* node = cache->freeNodes;
+    cache->freeNodes = node->next;
+    return node;
 }
 
-char* get(LRUCache* cache, int key) {
-    Node* node = hashGet(cache, key);
+static void releaseNode(LRUCache* cache, Node* node) {
+    clearValue(node);
+    node->prev = NULL;
+    node->next = cache->freeNodes;
+    cache->freeNodes = node;
+}
 
-    if(!node) {
-        return NULL;
+static size_t entryWeight(LRUCache* cache, int key, const char* value, size_t length) {
+    if(!cache->byteBudget) {
+        return 1;
     }
 
-    moveToFront(cache, node);
-    return node->value;
+    size_t weight = cache->weigher ? cache->weigher(key, value, length, cache->weigherContext)
+                                   : ENTRY_OVERHEAD_BYTES + valueFootprint(length);
+    if(weight == 0) {
+        weight = 1;
+    }
+    return weight < UINT32_MAX ? weight : UINT32_MAX;
 }
 
-void put(LRUCache* cache, int key, const char* value) {
-    Node* node = hashGet(cache, key);
+static int64_t cacheNowMillis(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-    if(node != NULL) {
-        free(node->value);
-        node->value = strdup(value);
-        moveToFront(cache, node);
+static int isExpired(const Node* node, int64_t now) {
+    return node->expiresAt != 0 && node->expiresAt <= now;
+}
+
+static void timerSchedule(TimerWheel* wheel, Node* node) {
+    int64_t delta = node->expiresAt - wheel->currentTime;
+    int level = 0;
+
+    while(level < TIMER_LEVELS - 1 && delta >= ((int64_t)1 << (TIMER_BITS * (level + 1)))) {
+        level++;
+    }
+
+    int64_t slotTime = delta > 0 ? node->expiresAt : wheel->currentTime + 1;
+    int bucket = (int)((slotTime >> (TIMER_BITS * level)) & (TIMER_BUCKETS - 1));
+
+    node->timerLevel = (uint8_t)level;
+    node->timerBucket = (uint8_t)bucket;
+    node->timerPrev = NULL;
+    node->timerNext = wheel->buckets[level][bucket];
+    if(node->timerNext) {
+        node->timerNext->timerPrev = node;
+    }
+    wheel->buckets[level][bucket] = node;
+    wheel->count++;
+}
+
+static void timerCancel(TimerWheel* wheel, Node* node) {
+    if(node->timerLevel == TIMER_UNSCHEDULED) {
         return;
     }
 
-    if(cache->size >= cache->capacity) {
-        removeLRU(cache);
+    if(node->timerPrev) {
+        node->timerPrev->timerNext = node->timerNext;
+    } else {
+        wheel->buckets[node->timerLevel][node->timerBucket] = node->timerNext;
+    }
+    if(node->timerNext) {
+        node->timerNext->timerPrev = node->timerPrev;
     }
 
-    insertAtFront(cache, key, value);
+    node->timerPrev = NULL;
+    node->timerNext = NULL;
+    node->timerLevel = TIMER_UNSCHEDULED;
+    wheel->count--;
 }
 
-void freeCache(LRUCache* cache) {
+static int sketchInit(FrequencySketch* sketch, int capacity) {
+    size_t width = 16;
+    while(width < (size_t)capacity) {
+        width <<= 1;
+    }
+
+    sketch->counters = (uint8_t*)calloc(width * SKETCH_DEPTH, sizeof(uint8_t));
+    if(!sketch->counters) {
+        return 0;
+    }
+    sketch->widthMask = width - 1;
+    sketch->additions = 0;
+    sketch->resetThreshold = (long)capacity * SKETCH_RESET_MULTIPLIER;
+    return 1;
+}
+
+static size_t sketchIndex(const FrequencySketch* sketch, int key, int row) {
+    size_t column = hash((int)((uint32_t)key * sketchSeeds[row])) & sketch->widthMask;
+    return (size_t)row * (sketch->widthMask + 1) + column;
+}
+
+static void sketchIncrement(FrequencySketch* sketch, int key) {
+    for(int row = 0; row < SKETCH_DEPTH; row++) {
+        uint8_t* counter = &sketch->counters[sketchIndex(sketch, key, row)];
+        if(*counter < SKETCH_MAX_COUNT) {
+            (*counter)++;
+        }
+    }
+
+    if(++sketch->additions >= sketch->resetThreshold) {
+        size_t total = (sketch->widthMask + 1) * SKETCH_DEPTH;
+        for(size_t counterIndex = 0; counterIndex < total; counterIndex++) {
+            sketch->counters[counterIndex] >>= 1;
+        }
+        sketch->additions /= 2;
+    }
+}
+
+static int sketchFrequency(const FrequencySketch* sketch, int key) {
+    int frequency = SKETCH_MAX_COUNT;
+
+    for(int row = 0; row < SKETCH_DEPTH; row++) {
+        int count = sketch->counters[sketchIndex(sketch, key, row)];
+        if(count < frequency) {
+            frequency = count;
+        }
+    }
+    return frequency;
+}
+
+LRUCache* createCacheWithConfig(const CacheConfig* config) {
+    LRUCache* cache = (LRUCache*)calloc(1, sizeof(LRUCache));
+
     if(!cache) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+
+    cache->byteBudget = config->maxBytes > 0;
+    cache->weigher = config->weigher;
+    cache->weigherContext = config->weigherContext;
+    size_t capacity = cache->byteBudget ? config->maxBytes : (size_t)(config->capacity > 0 ? config->capacity : 1);
+    cache->capacity = capacity;
+    cache->policy = config->policy;
+    cache->defaultTtlMs = config->defaultTtlMs;
+    cache->timers.currentTime = cacheNowMillis();
+
+    size_t poolSize = capacity;
+    size_t expectedEntries = capacity;
+    switch(cache->policy) {
+        case POLICY_SLRU:
+            cache->protectedCapacity = capacity * 4 / 5;
+            break;
+        case POLICY_2Q:
+            cache->windowCapacity = capacity / 4 > 0 ? capacity / 4 : 1;
+            cache->ghostCapacity = capacity / 2 > 0 ? capacity / 2 : 1;
+            poolSize = capacity + cache->ghostCapacity;
+            break;
+        case POLICY_ARC:
+            poolSize = capacity * 2;
+            break;
+        case POLICY_TINYLFU:
+            cache->windowCapacity = capacity / 100 > 0 ? capacity / 100 : 1;
+            cache->protectedCapacity = (capacity - cache->windowCapacity) * 4 / 5;
+            poolSize = capacity + 1;
+            break;
+        default:
+            break;
+    }
+
+    if(cache->byteBudget) {
+        expectedEntries = capacity / (ENTRY_OVERHEAD_BYTES + SLAB_MIN_CHUNK * 4) + 1;
+        poolSize = NODE_BLOCK_SIZE;
+    }
+
+    if(cache->policy == POLICY_TINYLFU && !sketchInit(&cache->sketch, (int)expectedEntries)) {
+        printf("Memory allocation failed\n");
+        free(cache);
+        return NULL;
+    }
+
+    if(!growNodePool(cache, poolSize)) {
+        free(cache->sketch.counters);
+        free(cache);
+        return NULL;
+    }
+
+    cache->index.slots = (HashSlot*)calloc(HASH_INITIAL_SLOTS, sizeof(HashSlot));
+    if(!cache->index.slots) {
+        printf("Memory allocation failed\n");
+        free(cache->nodeBlocks);
+        free(cache->sketch.counters);
+        free(cache);
+        return NULL;
+    }
+    cache->index.mask = HASH_INITIAL_SLOTS - 1;
+
+    cache->arena = (ValueArena*)calloc(1, sizeof(ValueArena));
+    if(!cache->arena) {
+        printf("Memory allocation failed\n");
+        free(cache->index.slots);
+        free(cache->nodeBlocks);
+        free(cache->sketch.counters);
+        free(cache);
+        return NULL;
+    }
+    cache->arena->references = 1;
+
+    return cache;
+}
+
+LRUCache* createCache(int capacity) {
+    CacheConfig config = { .capacity = capacity, .shardCount = 1, .policy = POLICY_LRU };
+    return createCacheWithConfig(&config);
+}
+
+static HashSlot* probeSlots(HashSlot* slots, size_t mask, int key, size_t keyHash) {
+    size_t slotIndex = keyHash & mask;
+
+    while(slots[slotIndex].node != NULL) {
+        if(slots[slotIndex].key == key && slots[slotIndex].node != HASH_TOMBSTONE) {
+            return &slots[slotIndex];
+        }
+        slotIndex = (slotIndex + 1) & mask;
+    }
+    return NULL;
+}
+
+static void insertSlot(HashIndex* index, int key, Node* node) {
+    size_t slotIndex = hash(key) & index->mask;
+
+    while(index->slots[slotIndex].node != NULL) {
+        slotIndex = (slotIndex + 1) & index->mask;
+    }
+
+    index->slots[slotIndex].key = key;
+    index->slots[slotIndex].node = node;
+    index->count++;
+}
+
+static void hashMigrateStep(HashIndex* index) {
+    if(!index->oldSlots) {
         return;
     }
 
-    Node* current = cache->head;
-    while(current) {
-        Node* next = current->next;
-        free(current->value);
-        free(current);
-        current = next;
+    for(int step = 0; step < HASH_MIGRATE_STEP && index->migrateCursor <= index->oldMask; step++) {
+        HashSlot* slot = &index->oldSlots[index->migrateCursor++];
+
+        if(slot->node != NULL && slot->node != HASH_TOMBSTONE) {
+            insertSlot(index, slot->key, slot->node);
+            slot->node = HASH_TOMBSTONE;
+            index->oldCount--;
+        }
+    }
+
+    if(index->migrateCursor > index->oldMask) {
+        free(index->oldSlots);
+        index->oldSlots = NULL;
+        index->oldMask = 0;
+        index->oldCount = 0;
+    }
+}
+
+static int hashGrow(HashIndex* index) {
+    while(index->oldSlots) {
+        hashMigrateStep(index);
+    }
+
+    size_t slotCount = (index->mask + 1) * 2;
+    HashSlot* slots = (HashSlot*)calloc(slotCount, sizeof(HashSlot));
+    if(!slots) {
+        printf("Memory allocation failed\n");
+        return 0;
     }
 
-    for(int index = 0; index < HASH_MAP_SIZE; index++) {
-        HashMapNode* bucket = cache->hashMap[index];
+    index->oldSlots = index->slots;
+    index->oldMask = index->mask;
+    index->oldCount = index->count;
+    index->migrateCursor = 0;
+
+    index->slots = slots;
+    index->mask = slotCount - 1;
+    index->count = 0;
+    return 1;
+}
+
+int hashPut(LRUCache* cache, int key, Node* node) {
+    HashIndex* index = &cache->index;
+    size_t keyHash = hash(key);
+    hashMigrateStep(index);
+
+    HashSlot* slot = probeSlots(index->slots, index->mask, key, keyHash);
+    if(!slot && index->oldSlots) {
+        slot = probeSlots(index->oldSlots, index->oldMask, key, keyHash);
+    }
+    if(slot) {
+        slot->node = node;
+        return 1;
+    }
 
-        while(bucket) {
-            HashMapNode* next = bucket->next;
-            free(bucket);
-            bucket = next;
+    if((index->count + index->oldCount + 1) * 4 > (index->mask + 1) * 3) {
+        if(!hashGrow(index) && index->count + 1 > index->mask) {
+            return 0;
         }
     }
 
-    free(cache);
+    insertSlot(index, key, node);
+    return 1;
 }
 
-int main() {
-    char command[50];
-    LRUCache* cache = NULL;
+static Node* hashGetHashed(LRUCache* cache, int key, size_t keyHash) {
+    HashIndex* index = &cache->index;
+    HashSlot* slot = probeSlots(index->slots, index->mask, key, keyHash);
+
+    if(!slot && index->oldSlots) {
+        slot = probeSlots(index->oldSlots, index->oldMask, key, keyHash);
+    }
+    return slot ? slot->node : NULL;
+}
+
+Node* hashGet(LRUCache* cache, int key) {
+    return hashGetHashed(cache, key, hash(key));
+}
+
+static void prefetchSlot(LRUCache* cache, size_t keyHash) {
+    __builtin_prefetch(&cache->index.slots[keyHash & cache->index.mask]);
+}
+
+void hashRemove(LRUCache* cache, int key) {
+    HashIndex* index = &cache->index;
+    size_t keyHash = hash(key);
+    hashMigrateStep(index);
+
+    if(index->oldSlots) {
+        HashSlot* oldSlot = probeSlots(index->oldSlots, index->oldMask, key, keyHash);
+        if(oldSlot) {
+            oldSlot->node = HASH_TOMBSTONE;
+            index->oldCount--;
+            return;
+        }
+    }
+
+    HashSlot* slot = probeSlots(index->slots, index->mask, key, keyHash);
+    if(!slot) {
+        return;
+    }
+
+    size_t hole = (size_t)(slot - index->slots);
+    size_t next = hole;
 
     while(1) {
-        scanf("%s", command);
-        
-        if(strcmp(command, "createCache") == 0) {
-            int size;
-            scanf("%d", &size);
-            cache = createCache(size);
-        } else if(strcmp(command, "put") == 0) {
-            int key;
-            char value[100];
-            scanf("%d %s", &key, value);
-            put(cache, key, value);
-        } else if(strcmp(command, "get") == 0) {
-            int key;
-            scanf("%d", &key);
-            char* result = get(cache, key);
-            if(result) {
-                printf("%s\n", result);
-            } else {
-                printf("NULL\n");
+        next = (next + 1) & index->mask;
+        if(index->slots[next].node == NULL) {
+            break;
+        }
+
+        size_t home = hash(index->slots[next].key) & index->mask;
+        int homeBetween = (hole <= next) ? (hole < home && home <= next)
+                                         : (hole < home || home <= next);
+        if(homeBetween) {
+            continue;
+        }
+
+        index->slots[hole] = index->slots[next];
+        hole = next;
+    }
+
+    index->slots[hole].node = NULL;
+    index->count--;
+}
+
+static int isGhost(const Node* node) {
+    return node->segment >= SEG_GHOST_RECENT;
+}
+
+static void listUnlink(NodeList* list, Node* node) {
+    if(node->prev) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+
+    if(node->next) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
+
+    node->prev = NULL;
+    node->next = NULL;
+    list->size--;
+    list->weight -= node->weight;
+}
+
+static void listPushFront(NodeList* list, Node* node) {
+    node->prev = NULL;
+    node->next = list->head;
+
+    if(list->head) {
+        list->head->prev = node;
+    }
+    list->head = node;
+
+    if(list->tail == NULL) {
+        list->tail = node;
+    }
+    list->size++;
+    list->weight += node->weight;
+}
+
+static void moveToSegment(LRUCache* cache, Node* node, Segment segment) {
+    listUnlink(&cache->lists[node->segment], node);
+    node->segment = segment;
+    listPushFront(&cache->lists[segment], node);
+}
+
+void moveToFront(LRUCache* cache, Node* node) {
+    if(cache->lists[node->segment].head == node) {
+        return;
+    }
+    moveToSegment(cache, node, node->segment);
+}
+
+static void removeNode(LRUCache* cache, Node* node) {
+    timerCancel(&cache->timers, node);
+    if(!isGhost(node)) {
+        cache->size--;
+        cache->weight -= node->weight;
+    }
+
+    listUnlink(&cache->lists[node->segment], node);
+    hashRemove(cache, node->key);
+    releaseNode(cache, node);
+}
+
+static void evictNode(LRUCache* cache, Node* node) {
+    if(!isGhost(node)) {
+        cache->evictions++;
+    }
+    removeNode(cache, node);
+}
+
+static void evictTail(LRUCache* cache, Segment segment) {
+    if(cache->lists[segment].tail) {
+        evictNode(cache, cache->lists[segment].tail);
+    }
+}
+
+static void demoteToGhost(LRUCache* cache, Node* node, Segment ghostSegment) {
+    if(!node) {
+        return;
+    }
+
+    timerCancel(&cache->timers, node);
+    clearValue(node);
+    cache->evictions++;
+    moveToSegment(cache, node, ghostSegment);
+    cache->size--;
+    cache->weight -= node->weight;
+}
+
+static void detachGhost(LRUCache* cache, Node* ghost) {
+    listUnlink(&cache->lists[ghost->segment], ghost);
+}
+
+static void reviveGhost(LRUCache* cache, Node* ghost, const char* value, size_t length, size_t weight, Segment segment) {
+    if(!storeValue(cache, ghost, value, length)) {
+        hashRemove(cache, ghost->key);
+        releaseNode(cache, ghost);
+        return;
+    }
+
+    ghost->weight = (uint32_t)weight;
+    ghost->expiresAt = 0;
+    ghost->segment = segment;
+    listPushFront(&cache->lists[segment], ghost);
+    cache->size++;
+    cache->weight += weight;
+}
+
+static int overBudget(LRUCache* cache, size_t incoming) {
+    return cache->weight + incoming > cache->capacity && cache->size > 0;
+}
+
+void removeLRU(LRUCache* cache) {
+    evictTail(cache, SEG_RECENT);
+}
+
+Node* insertAtFront(LRUCache* cache, int key, const char* value, size_t length, size_t weight, Segment segment) {
+    Node* newNode = allocateNode(cache);
+    if(!newNode) {
+        return NULL;
+    }
+
+    newNode->key = key;
+    newNode->valueLength = 0;
+    if(!storeValue(cache, newNode, value, length)) {
+        releaseNode(cache, newNode);
+        return NULL;
+    }
+
+    if(!hashPut(cache, key, newNode)) {
+        releaseNode(cache, newNode);
+        return NULL;
+    }
+
+    newNode->weight = (uint32_t)weight;
+    newNode->expiresAt = 0;
+    newNode->timerLevel = TIMER_UNSCHEDULED;
+    newNode->segment = segment;
+    listPushFront(&cache->lists[segment], newNode);
+    cache->size++;
+    cache->weight += weight;
+    return newNode;
+}
+
+static void promoteToProtected(LRUCache* cache, Node* node) {
+    if(cache->protectedCapacity == 0) {
+        moveToFront(cache, node);
+        return;
+    }
+
+    moveToSegment(cache, node, SEG_FREQUENT);
+    NodeList* protectedList = &cache->lists[SEG_FREQUENT];
+    while(protectedList->weight > cache->protectedCapacity && protectedList->tail != node) {
+        moveToSegment(cache, protectedList->tail, SEG_PROBATION);
+    }
+}
+
+static void onHit(LRUCache* cache, Node* node) {
+    switch(cache->policy) {
+        case POLICY_SLRU:
+        case POLICY_TINYLFU:
+            if(node->segment == SEG_PROBATION) {
+                promoteToProtected(cache, node);
+            } else {
+                moveToFront(cache, node);
+            }
+            break;
+        case POLICY_2Q:
+            if(node->segment == SEG_FREQUENT) {
+                moveToFront(cache, node);
+            }
+            break;
+        case POLICY_ARC:
+            moveToSegment(cache, node, SEG_FREQUENT);
+            break;
+        default:
+            moveToFront(cache, node);
+            break;
+    }
+}
+
+static Node* selectVictim(LRUCache* cache, Node* exclude) {
+    static const Segment order[] = { SEG_PROBATION, SEG_RECENT, SEG_FREQUENT };
+
+    for(int orderIndex = 0; orderIndex < 3; orderIndex++) {
+        Node* victim = cache->lists[order[orderIndex]].tail;
+        if(victim && victim == exclude) {
+            victim = victim->prev;
+        }
+        if(victim) {
+            return victim;
+        }
+    }
+    return NULL;
+}
+
+static void admitLRU(LRUCache* cache, int key, const char* value, size_t length, size_t weight) {
+    while(overBudget(cache, weight)) {
+        removeLRU(cache);
+    }
+    insertAtFront(cache, key, value, length, weight, SEG_RECENT);
+}
+
+static void admitSLRU(LRUCache* cache, int key, const char* value, size_t length, size_t weight) {
+    while(overBudget(cache, weight)) {
+        evictTail(cache, cache->lists[SEG_PROBATION].tail ? SEG_PROBATION : SEG_FREQUENT);
+    }
+    insertAtFront(cache, key, value, length, weight, SEG_PROBATION);
+}
+
+static void admit2Q(LRUCache* cache, int key, const char* value, size_t length, size_t weight, Node* ghost) {
+    if(ghost) {
+        detachGhost(cache, ghost);
+    }
+
+    while(overBudget(cache, weight)) {
+        if(cache->lists[SEG_RECENT].weight > cache->windowCapacity || cache->lists[SEG_FREQUENT].size == 0) {
+            demoteToGhost(cache, cache->lists[SEG_RECENT].tail, SEG_GHOST_RECENT);
+            while(cache->lists[SEG_GHOST_RECENT].weight > cache->ghostCapacity) {
+                evictTail(cache, SEG_GHOST_RECENT);
+            }
+        } else {
+            evictTail(cache, SEG_FREQUENT);
+        }
+    }
+
+    if(ghost) {
+        reviveGhost(cache, ghost, value, length, weight, SEG_FREQUENT);
+    } else {
+        insertAtFront(cache, key, value, length, weight, SEG_RECENT);
+    }
+}
+
+static void arcReplace(LRUCache* cache, size_t incoming, int ghostWasFrequent) {
+    while(overBudget(cache, incoming)) {
+        NodeList* recent = &cache->lists[SEG_RECENT];
+        if(recent->size >= 1 &&
+           ((ghostWasFrequent && recent->weight == cache->arcTarget) || recent->weight > cache->arcTarget)) {
+            demoteToGhost(cache, recent->tail, SEG_GHOST_RECENT);
+        } else if(cache->lists[SEG_FREQUENT].tail) {
+            demoteToGhost(cache, cache->lists[SEG_FREQUENT].tail, SEG_GHOST_FREQUENT);
+        } else {
+            demoteToGhost(cache, recent->tail, SEG_GHOST_RECENT);
+        }
+    }
+}
+
+static void admitARC(LRUCache* cache, int key, const char* value, size_t length, size_t weight, Node* ghost) {
+    size_t capacity = cache->capacity;
+    size_t recentGhosts = cache->lists[SEG_GHOST_RECENT].weight;
+    size_t frequentGhosts = cache->lists[SEG_GHOST_FREQUENT].weight;
+
+    if(ghost && ghost->segment == SEG_GHOST_RECENT) {
+        size_t delta = (recentGhosts >= frequentGhosts ? 1 : frequentGhosts / recentGhosts) * ghost->weight;
+        cache->arcTarget = cache->arcTarget + delta < capacity ? cache->arcTarget + delta : capacity;
+        detachGhost(cache, ghost);
+        arcReplace(cache, weight, 0);
+        reviveGhost(cache, ghost, value, length, weight, SEG_FREQUENT);
+        return;
+    }
+
+    if(ghost) {
+        size_t delta = (frequentGhosts >= recentGhosts ? 1 : recentGhosts / frequentGhosts) * ghost->weight;
+        cache->arcTarget = cache->arcTarget > delta ? cache->arcTarget - delta : 0;
+        detachGhost(cache, ghost);
+        arcReplace(cache, weight, 1);
+        reviveGhost(cache, ghost, value, length, weight, SEG_FREQUENT);
+        return;
+    }
+
+    while(cache->lists[SEG_RECENT].weight + cache->lists[SEG_GHOST_RECENT].weight + weight > capacity) {
+        if(cache->lists[SEG_GHOST_RECENT].tail) {
+            evictTail(cache, SEG_GHOST_RECENT);
+        } else if(cache->lists[SEG_RECENT].tail) {
+            evictTail(cache, SEG_RECENT);
+        } else {
+            break;
+        }
+    }
+
+    while(cache->lists[SEG_FREQUENT].weight + cache->lists[SEG_GHOST_FREQUENT].weight +
+          cache->lists[SEG_RECENT].weight + cache->lists[SEG_GHOST_RECENT].weight + weight > 2 * capacity &&
+          cache->lists[SEG_GHOST_FREQUENT].tail) {
+        evictTail(cache, SEG_GHOST_FREQUENT);
+    }
+
+    arcReplace(cache, weight, 0);
+    insertAtFront(cache, key, value, length, weight, SEG_RECENT);
+}
+
+static void admitTinyLFU(LRUCache* cache, int key, const char* value, size_t length, size_t weight) {
+    if(!insertAtFront(cache, key, value, length, weight, SEG_RECENT)) {
+        return;
+    }
+
+    while(cache->lists[SEG_RECENT].weight > cache->windowCapacity && cache->lists[SEG_RECENT].tail) {
+        Node* candidate = cache->lists[SEG_RECENT].tail;
+        moveToSegment(cache, candidate, SEG_PROBATION);
+
+        while(cache->weight > cache->capacity) {
+            Node* victim = cache->lists[SEG_PROBATION].tail;
+            if(victim == candidate) {
+                victim = candidate->prev ? candidate->prev : cache->lists[SEG_FREQUENT].tail;
+            }
+
+            if(victim &&
+               sketchFrequency(&cache->sketch, candidate->key) > sketchFrequency(&cache->sketch, victim->key)) {
+                evictNode(cache, victim);
+            } else {
+                evictNode(cache, candidate);
+                break;
+            }
+        }
+    }
+
+    while(cache->weight > cache->capacity) {
+        Node* victim = selectVictim(cache, NULL);
+        if(!victim) {
+            break;
+        }
+        evictNode(cache, victim);
+    }
+}
+
+static void applyAccess(LRUCache* cache, int key) {
+    if(cache->policy == POLICY_TINYLFU) {
+        sketchIncrement(&cache->sketch, key);
+    }
+
+    Node* node = hashGet(cache, key);
+    if(node && !isGhost(node)) {
+        onHit(cache, node);
+    }
+}
+
+static void setExpiry(LRUCache* cache, Node* node, int64_t expiresAt) {
+    timerCancel(&cache->timers, node);
+    node->expiresAt = expiresAt;
+    if(expiresAt != 0) {
+        timerSchedule(&cache->timers, node);
+    }
+}
+
+void expireEntries(LRUCache* cache, int64_t now) {
+    TimerWheel* wheel = &cache->timers;
+    int64_t previous = wheel->currentTime;
+
+    if(now <= previous) {
+        return;
+    }
+    wheel->currentTime = now;
+    if(wheel->count == 0) {
+        return;
+    }
+
+    for(int level = 0; level < TIMER_LEVELS; level++) {
+        int shift = TIMER_BITS * level;
+        int64_t from = previous >> shift;
+        int64_t to = now >> shift;
+        if(from == to) {
+            break;
+        }
+
+        int64_t steps = to - from < TIMER_BUCKETS ? to - from : TIMER_BUCKETS;
+        for(int64_t step = 1; step <= steps; step++) {
+            int bucket = (int)((from + step) & (TIMER_BUCKETS - 1));
+            Node* node = wheel->buckets[level][bucket];
+            wheel->buckets[level][bucket] = NULL;
+
+            while(node) {
+                Node* next = node->timerNext;
+                node->timerLevel = TIMER_UNSCHEDULED;
+                node->timerPrev = NULL;
+                node->timerNext = NULL;
+                wheel->count--;
+
+                if(node->expiresAt <= now) {
+                    cache->expirations++;
+                    removeNode(cache, node);
+                } else {
+                    timerSchedule(wheel, node);
+                }
+                node = next;
+            }
+        }
+    }
+}
+
+static Node* lookupNode(LRUCache* cache, int key) {
+    if(cache->timers.count > 0) {
+        expireEntries(cache, cacheNowMillis());
+    }
+
+    Node* node = hashGet(cache, key);
+
+    if(cache->policy == POLICY_TINYLFU) {
+        sketchIncrement(&cache->sketch, key);
+    }
+
+    if(!node || isGhost(node) || isExpired(node, cache->timers.currentTime)) {
+        cache->misses++;
+        return NULL;
+    }
+
+    cache->hits++;
+    onHit(cache, node);
+    return node;
+}
+
+/* The returned pointer is only valid until the entry is next written or
+   evicted; use getValue for a reference that outlives both. */
+const char* get(LRUCache* cache, int key) {
+    Node* node = lookupNode(cache, key);
+    return node ? nodeValue(node) : NULL;
+}
+
+int getValue(LRUCache* cache, int key, ValueHandle* handle) {
+    Node* node = lookupNode(cache, key);
+    if(!node) {
+        handle->length = -1;
+        handle->buffer = NULL;
+        handle->expiresAt = 0;
+        return -1;
+    }
+
+    acquireValue(node, handle);
+    return handle->length;
+}
+
+static void updateValue(LRUCache* cache, Node* node, const char* value, size_t length, size_t weight, int64_t expiresAt) {
+    if(weight > cache->capacity || !storeValue(cache, node, value, length)) {
+        evictNode(cache, node);
+        return;
+    }
+
+    setExpiry(cache, node, expiresAt);
+
+    cache->lists[node->segment].weight += weight;
+    cache->lists[node->segment].weight -= node->weight;
+    cache->weight += weight;
+    cache->weight -= node->weight;
+    node->weight = (uint32_t)weight;
+    onHit(cache, node);
+
+    while(cache->weight > cache->capacity) {
+        Node* victim = selectVictim(cache, node);
+        if(!victim) {
+            break;
+        }
+        evictNode(cache, victim);
+    }
+}
+
+void putValue(LRUCache* cache, int key, const char* value, size_t length, long ttlMs) {
+    int64_t now = cacheNowMillis();
+    expireEntries(cache, now);
+
+    Node* node = hashGet(cache, key);
+    size_t weight = entryWeight(cache, key, value, length);
+    if(ttlMs == TTL_DEFAULT) {
+        ttlMs = cache->defaultTtlMs;
+    }
+    int64_t expiresAt = ttlMs > 0 ? now + ttlMs : 0;
+
+    if(cache->policy == POLICY_TINYLFU) {
+        sketchIncrement(&cache->sketch, key);
+    }
+
+    if(node != NULL && !isGhost(node)) {
+        cache->updates++;
+        updateValue(cache, node, value, length, weight, expiresAt);
+        return;
+    }
+
+    if(weight > cache->capacity) {
+        return;
+    }
+
+    cache->inserts++;
+    switch(cache->policy) {
+        case POLICY_SLRU:
+            admitSLRU(cache, key, value, length, weight);
+            break;
+        case POLICY_2Q:
+            admit2Q(cache, key, value, length, weight, node);
+            break;
+        case POLICY_ARC:
+            admitARC(cache, key, value, length, weight, node);
+            break;
+        case POLICY_TINYLFU:
+            admitTinyLFU(cache, key, value, length, weight);
+            break;
+        default:
+            admitLRU(cache, key, value, length, weight);
+            break;
+    }
+
+    if(expiresAt != 0) {
+        node = hashGet(cache, key);
+        if(node && !isGhost(node)) {
+            setExpiry(cache, node, expiresAt);
+        }
+    }
+}
+
+void put(LRUCache* cache, int key, const char* value) {
+    putValue(cache, key, value, strlen(value), TTL_DEFAULT);
+}
+
+int removeKey(LRUCache* cache, int key) {
+    Node* node = hashGet(cache, key);
+
+    if(!node || isGhost(node)) {
+        return 0;
+    }
+
+    int wasLive = !isExpired(node, cacheNowMillis());
+    removeNode(cache, node);
+    return wasLive;
+}
+
+static void listPushBack(NodeList* list, Node* node) {
+    node->next = NULL;
+    node->prev = list->tail;
+
+    if(list->tail) {
+        list->tail->next = node;
+    }
+    list->tail = node;
+
+    if(list->head == NULL) {
+        list->head = node;
+    }
+    list->size++;
+    list->weight += node->weight;
+}
+
+static Segment restoreSegment(LRUCache* cache, Segment segment, size_t weight) {
+    switch(cache->policy) {
+        case POLICY_SLRU:
+        case POLICY_TINYLFU:
+            if(segment == SEG_FREQUENT && cache->lists[SEG_FREQUENT].weight + weight <= cache->protectedCapacity) {
+                return SEG_FREQUENT;
+            }
+            if(cache->policy == POLICY_TINYLFU && segment == SEG_RECENT &&
+               cache->lists[SEG_RECENT].weight + weight <= cache->windowCapacity) {
+                return SEG_RECENT;
+            }
+            return SEG_PROBATION;
+        case POLICY_2Q:
+        case POLICY_ARC:
+            return segment == SEG_FREQUENT ? SEG_FREQUENT : SEG_RECENT;
+        default:
+            return SEG_RECENT;
+    }
+}
+
+/* Snapshots are replayed hottest first, so each restored entry goes to the
+   cold end of its segment. Returns 1 when restored, 0 when skipped and -1
+   once the cache has no room left for any further entry. */
+int restoreEntry(LRUCache* cache, int key, const char* value, size_t length, Segment segment, long ttlMs) {
+    Node* existing = hashGet(cache, key);
+    if(existing && !isGhost(existing)) {
+        return 0;
+    }
+
+    size_t weight = entryWeight(cache, key, value, length);
+    if(cache->weight + weight > cache->capacity) {
+        return cache->capacity - cache->weight < entryWeight(cache, key, "", 0) ? -1 : 0;
+    }
+    if(existing) {
+        removeNode(cache, existing);
+    }
+
+    segment = restoreSegment(cache, segment, weight);
+    Node* node = insertAtFront(cache, key, value, length, weight, segment);
+    if(!node) {
+        return 0;
+    }
+    listUnlink(&cache->lists[segment], node);
+    listPushBack(&cache->lists[segment], node);
+
+    if(ttlMs > 0) {
+        int64_t now = cacheNowMillis();
+        expireEntries(cache, now);
+        setExpiry(cache, node, now + ttlMs);
+    }
+    return 1;
+}
+
+void freeCache(LRUCache* cache) {
+    if(!cache) {
+        return;
+    }
+
+    for(int segment = 0; segment < SEGMENT_COUNT; segment++) {
+        Node* current = cache->lists[segment].head;
+        while(current) {
+            Node* next = current->next;
+            releaseNode(cache, current);
+            current = next;
+        }
+    }
+
+    arenaRelease(cache->arena);
+    free(cache->sketch.counters);
+
+    NodeBlock* block = cache->nodeBlocks;
+    while(block) {
+        NodeBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(cache->index.slots);
+    free(cache->index.oldSlots);
+
+    free(cache);
+}
+
+static int growBuffer(char** buffer, size_t* capacity, size_t needed) {
+    if(needed <= *capacity) {
+        return 1;
+    }
+
+    size_t newCapacity = *capacity ? *capacity : 1024;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+
+    char* grown = (char*)realloc(*buffer, newCapacity);
+    if(!grown) {
+        return 0;
+    }
+    *buffer = grown;
+    *capacity = newCapacity;
+    return 1;
+}
+
+static CacheShard* shardFor(ShardedCache* sharded, int key) {
+    if(sharded->shardBits == 0) {
+        return &sharded->shards[0];
+    }
+    uint32_t mixed = (uint32_t)key * 0x9e3779b9U;
+    return &sharded->shards[mixed >> (32 - sharded->shardBits)];
+}
+
+static void drainReadBuffers(CacheShard* shard) {
+    for(int stripe = 0; stripe < READ_BUFFER_STRIPES; stripe++) {
+        ReadBuffer* buffer = &shard->readBuffers[stripe];
+        uint32_t writeCount = __atomic_load_n(&buffer->writeCount, __ATOMIC_ACQUIRE);
+        uint32_t readCount = buffer->readCount;
+
+        if(writeCount - readCount > READ_BUFFER_SIZE) {
+            readCount = writeCount - READ_BUFFER_SIZE;
+        }
+
+        for(; readCount != writeCount; readCount++) {
+            int64_t *slot = &buffer->keys[readCount & (READ_BUFFER_SIZE - 1)];
+            int64_t key = __atomic_exchange_n(slot, READ_BUFFER_EMPTY, __ATOMIC_ACQ_REL);
+            if(key == READ_BUFFER_EMPTY) {
+                continue;
+            }
+
+            applyAccess(shard->cache, (int)key);
+        }
+        __atomic_store_n(&buffer->readCount, writeCount, __ATOMIC_RELEASE);
+    }
+}
+
+static void recordAccesses(CacheShard* shard, const int* keys, uint32_t count) {
+    if(count == 0) {
+        return;
+    }
+    if(threadStripe < 0) {
+        threadStripe = __atomic_fetch_add(&nextThreadStripe, 1, __ATOMIC_RELAXED) % READ_BUFFER_STRIPES;
+    }
+
+    ReadBuffer* buffer = &shard->readBuffers[threadStripe];
+    uint32_t readCount = __atomic_load_n(&buffer->readCount, __ATOMIC_ACQUIRE);
+    uint32_t claim = __atomic_fetch_add(&buffer->writeCount, count, __ATOMIC_ACQ_REL);
+    uint32_t pending = claim - readCount;
+
+    for(uint32_t keyIndex = 0; keyIndex < count && pending + keyIndex < READ_BUFFER_SIZE; keyIndex++) {
+        __atomic_store_n(&buffer->keys[(claim + keyIndex) & (READ_BUFFER_SIZE - 1)], (int64_t)keys[keyIndex],
+                         __ATOMIC_RELEASE);
+    }
+
+    if(pending + count >= READ_BUFFER_DRAIN_THRESHOLD && pthread_rwlock_trywrlock(&shard->lock) == 0) {
+        drainReadBuffers(shard);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
+
+static void recordAccess(CacheShard* shard, int key) {
+    recordAccesses(shard, &key, 1);
+}
+
+static ThreadCounters* threadCountersFor(ShardedCache* sharded) {
+    if(threadCountersId == sharded->statsId) {
+        return threadCounters;
+    }
+
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&sharded->countersLock);
+    ThreadCounters* counters = sharded->counters;
+    while(counters && !pthread_equal(counters->owner, self)) {
+        counters = counters->next;
+    }
+    if(!counters) {
+        counters = (ThreadCounters*)calloc(1, sizeof(ThreadCounters) +
+                                              2 * (size_t)sharded->shardCount * sizeof(uint64_t));
+        if(counters) {
+            counters->owner = self;
+            counters->next = sharded->counters;
+            sharded->counters = counters;
+        }
+    }
+    pthread_mutex_unlock(&sharded->countersLock);
+
+    if(!counters) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+    threadCounters = counters;
+    threadCountersId = sharded->statsId;
+    return counters;
+}
+
+static void bumpCounter(uint64_t* counter, uint64_t amount) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+static void countLookups(ShardedCache* sharded, CacheShard* shard, uint64_t hits, uint64_t misses) {
+    ThreadCounters* counters = threadCountersFor(sharded);
+    if(!counters) {
+        return;
+    }
+
+    size_t shardIndex = (size_t)(shard - sharded->shards);
+    if(hits) {
+        bumpCounter(&counters->shardCounters[2 * shardIndex], hits);
+    }
+    if(misses) {
+        bumpCounter(&counters->shardCounters[2 * shardIndex + 1], misses);
+    }
+}
+
+static int64_t cacheNowNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Times roughly one operation in 2^LATENCY_SAMPLE_BITS, picked by a
+   per-thread LCG so alternating gets and puts are both sampled; returns 0
+   when this one is not sampled. */
+static int64_t latencyStart(void) {
+    latencySampleState = latencySampleState * 6364136223846793005ULL + 1442695040888963407ULL;
+    if((latencySampleState >> (64 - LATENCY_SAMPLE_BITS)) != 0) {
+        return 0;
+    }
+    return cacheNowNanos();
+}
+
+static int latencyBucket(uint64_t nanos) {
+    int bucket = nanos ? 64 - __builtin_clzll(nanos) : 0;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/* Batched calls record their per-key average once per key. */
+static void recordLatency(ShardedCache* sharded, int isPut, int64_t started, size_t operations) {
+    if(started == 0 || operations == 0) {
+        return;
+    }
+
+    ThreadCounters* counters = threadCountersFor(sharded);
+    if(!counters) {
+        return;
+    }
+    uint64_t elapsed = (uint64_t)(cacheNowNanos() - started) / operations;
+    uint64_t* histogram = isPut ? counters->putLatency : counters->getLatency;
+    bumpCounter(&histogram[latencyBucket(elapsed)], operations);
+}
+
+/* shardCount 0 picks a power of two of shards, up to AUTO_SHARD_MAX, that
+   leaves each shard at least AUTO_SHARD_MIN_ENTRIES entries and, under a
+   byte budget, AUTO_SHARD_MIN_BYTES. Every shard evicts on its own, so
+   callers that need exact capacity and LRU order ask for one shard. */
+static int autoShardCount(const CacheConfig* config) {
+    int shardCount = AUTO_SHARD_MAX;
+    if(config->capacity > 0 && config->capacity / AUTO_SHARD_MIN_ENTRIES < shardCount) {
+        shardCount = config->capacity / AUTO_SHARD_MIN_ENTRIES;
+    }
+    if(config->maxBytes > 0 && config->maxBytes / AUTO_SHARD_MIN_BYTES < (size_t)shardCount) {
+        shardCount = (int)(config->maxBytes / AUTO_SHARD_MIN_BYTES);
+    }
+    if(config->capacity <= 0 && config->maxBytes == 0) {
+        shardCount = 1;
+    }
+
+    int rounded = 1;
+    while(rounded * 2 <= shardCount) {
+        rounded *= 2;
+    }
+    return rounded;
+}
+
+ShardedCache* createShardedCache(const CacheConfig* config) {
+    int shardCount = config->shardCount > 0 ? config->shardCount : autoShardCount(config);
+    int shardBits = 0;
+    while((1 << shardBits) < shardCount && (1 << shardBits) < MAX_SHARDS) {
+        shardBits++;
+    }
+    shardCount = 1 << shardBits;
+
+    ShardedCache* sharded = (ShardedCache*)malloc(sizeof(ShardedCache));
+    if(!sharded) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+
+    CacheShard* shards = NULL;
+    if(posix_memalign((void**)&shards, 64, (size_t)shardCount * sizeof(CacheShard)) != 0) {
+        printf("Memory allocation failed\n");
+        free(sharded);
+        return NULL;
+    }
+    memset(shards, 0, (size_t)shardCount * sizeof(CacheShard));
+
+    sharded->shardCount = shardCount;
+    sharded->shardBits = shardBits;
+    sharded->shards = shards;
+    sharded->statsId = __atomic_fetch_add(&nextStatsId, 1, __ATOMIC_RELAXED);
+    sharded->counters = NULL;
+    sharded->refreshAheadMs = config->refreshAheadMs;
+    pthread_mutex_init(&sharded->countersLock, NULL);
+
+    CacheConfig shardConfig = *config;
+    shardConfig.shardCount = 1;
+    shardConfig.capacity = (config->capacity + shardCount - 1) / shardCount;
+    shardConfig.maxBytes = (config->maxBytes + shardCount - 1) / shardCount;
+    for(int shardIndex = 0; shardIndex < shardCount; shardIndex++) {
+        CacheShard* shard = &shards[shardIndex];
+        pthread_rwlock_init(&shard->lock, NULL);
+        pthread_mutex_init(&shard->loadLock, NULL);
+        pthread_cond_init(&shard->loadDone, NULL);
+        for(int stripe = 0; stripe < READ_BUFFER_STRIPES; stripe++) {
+            for(int slot = 0; slot < READ_BUFFER_SIZE; slot++) {
+                shard->readBuffers[stripe].keys[slot] = READ_BUFFER_EMPTY;
+            }
+        }
+
+        shard->cache = createCacheWithConfig(&shardConfig);
+        if(!shard->cache) {
+            for(int created = 0; created <= shardIndex; created++) {
+                freeCache(shards[created].cache);
+                pthread_rwlock_destroy(&shards[created].lock);
+                pthread_mutex_destroy(&shards[created].loadLock);
+                pthread_cond_destroy(&shards[created].loadDone);
+            }
+            pthread_mutex_destroy(&sharded->countersLock);
+            free(shards);
+            free(sharded);
+            return NULL;
+        }
+    }
+
+    return sharded;
+}
+
+static int shardedLookup(ShardedCache* sharded, int key, char* out, size_t outSize, ValueHandle* handle) {
+    CacheShard* shard = shardFor(sharded, key);
+    int length = -1;
+    int64_t started = latencyStart();
+
+    pthread_rwlock_rdlock(&shard->lock);
+    Node* node = hashGet(shard->cache, key);
+    if(node && !isGhost(node) && !(node->expiresAt != 0 && isExpired(node, cacheNowMillis()))) {
+        length = (int)node->valueLength;
+        if(handle) {
+            acquireValue(node, handle);
+        } else if(out && outSize > 0) {
+            size_t copyLength = node->valueLength < outSize - 1 ? node->valueLength : outSize - 1;
+            memcpy(out, nodeValue(node), copyLength);
+            out[copyLength] = '\0';
+        }
+    } else if(handle) {
+        handle->length = -1;
+        handle->buffer = NULL;
+        handle->expiresAt = 0;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    if(length >= 0) {
+        countLookups(sharded, shard, 1, 0);
+        recordAccess(shard, key);
+    } else {
+        countLookups(sharded, shard, 0, 1);
+        if(shard->cache->policy == POLICY_TINYLFU) {
+            recordAccess(shard, key);
+        }
+    }
+    recordLatency(sharded, 0, started, 1);
+    return length;
+}
+
+int shardedGet(ShardedCache* sharded, int key, char* out, size_t outSize) {
+    return shardedLookup(sharded, key, out, outSize, NULL);
+}
+
+/* Zero-copy get: large values are shared with the cache, so the handle
+   must be passed to releaseValue once the caller is done with it. */
+int shardedGetValue(ShardedCache* sharded, int key, ValueHandle* handle) {
+    return shardedLookup(sharded, key, NULL, 0, handle);
+}
+
+void shardedPutValue(ShardedCache* sharded, int key, const char* value, size_t length, long ttlMs) {
+    CacheShard* shard = shardFor(sharded, key);
+    int64_t started = latencyStart();
+
+    pthread_rwlock_wrlock(&shard->lock);
+    drainReadBuffers(shard);
+    putValue(shard->cache, key, value, length, ttlMs);
+    pthread_rwlock_unlock(&shard->lock);
+    recordLatency(sharded, 1, started, 1);
+}
+
+void shardedPut(ShardedCache* sharded, int key, const char* value) {
+    shardedPutValue(sharded, key, value, strlen(value), TTL_DEFAULT);
+}
+
+int shardedDelete(ShardedCache* sharded, int key) {
+    CacheShard* shard = shardFor(sharded, key);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    drainReadBuffers(shard);
+    int removed = removeKey(shard->cache, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return removed;
+}
+
+static void freeBatchScratch(void* argument) {
+    BatchScratch* scratch = (BatchScratch*)argument;
+
+    free(scratch->shardOf);
+    free(scratch->order);
+    free(scratch->hashes);
+    free(scratch->hitKeys);
+    memset(scratch, 0, sizeof(BatchScratch));
+}
+
+static void createBatchScratchKey(void) {
+    pthread_key_create(&batchScratchKey, freeBatchScratch);
+}
+
+static int reserveBatchScratch(size_t count) {
+    BatchScratch* scratch = &batchScratch;
+
+    if(count <= scratch->capacity) {
+        return 1;
+    }
+    if(scratch->capacity == 0) {
+        pthread_once(&batchScratchOnce, createBatchScratchKey);
+        pthread_setspecific(batchScratchKey, scratch);
+    }
+
+    size_t capacity = scratch->capacity ? scratch->capacity : 64;
+    while(capacity < count) {
+        capacity *= 2;
+    }
+
+    uint32_t* shardOf = (uint32_t*)realloc(scratch->shardOf, capacity * sizeof(uint32_t));
+    if(shardOf) {
+        scratch->shardOf = shardOf;
+    }
+    uint32_t* order = (uint32_t*)realloc(scratch->order, capacity * sizeof(uint32_t));
+    if(order) {
+        scratch->order = order;
+    }
+    size_t* hashes = (size_t*)realloc(scratch->hashes, capacity * sizeof(size_t));
+    if(hashes) {
+        scratch->hashes = hashes;
+    }
+    int* hitKeys = (int*)realloc(scratch->hitKeys, capacity * sizeof(int));
+    if(hitKeys) {
+        scratch->hitKeys = hitKeys;
+    }
+
+    if(!shardOf || !order || !hashes || !hitKeys) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    scratch->capacity = capacity;
+    return 1;
+}
+
+static void groupByShard(ShardedCache* sharded, const int* keys, size_t keyStride, size_t count) {
+    BatchScratch* scratch = &batchScratch;
+    int shardCount = sharded->shardCount;
+
+    memset(scratch->starts, 0, sizeof(uint32_t) * (size_t)(shardCount + 1));
+    for(size_t keyIndex = 0; keyIndex < count; keyIndex++) {
+        int key = *(const int*)((const char*)keys + keyIndex * keyStride);
+        scratch->hashes[keyIndex] = hash(key);
+        scratch->shardOf[keyIndex] = (uint32_t)(shardFor(sharded, key) - sharded->shards);
+        scratch->starts[scratch->shardOf[keyIndex] + 1]++;
+    }
+    for(int shardIndex = 0; shardIndex < shardCount; shardIndex++) {
+        scratch->starts[shardIndex + 1] += scratch->starts[shardIndex];
+        scratch->cursor[shardIndex] = scratch->starts[shardIndex];
+    }
+    for(size_t keyIndex = 0; keyIndex < count; keyIndex++) {
+        scratch->order[scratch->cursor[scratch->shardOf[keyIndex]]++] = (uint32_t)keyIndex;
+    }
+}
+
+/* Fills one handle per key (length -1 on a miss); release every handle. */
+size_t shardedMultiGet(ShardedCache* sharded, const int* keys, size_t count, ValueHandle* results) {
+    if(count == 0 || !reserveBatchScratch(count)) {
+        return 0;
+    }
+
+    BatchScratch* scratch = &batchScratch;
+    size_t totalHits = 0;
+    int64_t started = latencyStart();
+    int64_t now = cacheNowMillis();
+
+    groupByShard(sharded, keys, sizeof(int), count);
+
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        uint32_t first = scratch->starts[shardIndex];
+        uint32_t last = scratch->starts[shardIndex + 1];
+        if(first == last) {
+            continue;
+        }
+
+        CacheShard* shard = &sharded->shards[shardIndex];
+        uint32_t hitCount = 0;
+
+        pthread_rwlock_rdlock(&shard->lock);
+        for(uint32_t position = first; position < last; position++) {
+            prefetchSlot(shard->cache, scratch->hashes[scratch->order[position]]);
+        }
+
+        for(uint32_t position = first; position < last; position++) {
+            uint32_t keyIndex = scratch->order[position];
+            int key = keys[keyIndex];
+            Node* node = hashGetHashed(shard->cache, key, scratch->hashes[keyIndex]);
+
+            if(!node || isGhost(node) || isExpired(node, now)) {
+                results[keyIndex].length = -1;
+                results[keyIndex].buffer = NULL;
+                results[keyIndex].expiresAt = 0;
+                continue;
+            }
+            acquireValue(node, &results[keyIndex]);
+            scratch->hitKeys[hitCount++] = key;
+        }
+        pthread_rwlock_unlock(&shard->lock);
+
+        countLookups(sharded, shard, hitCount, last - first - hitCount);
+        recordAccesses(shard, scratch->hitKeys, hitCount);
+        totalHits += hitCount;
+    }
+
+    recordLatency(sharded, 0, started, count);
+    return totalHits;
+}
+
+void shardedMultiPut(ShardedCache* sharded, const BatchPut* entries, size_t count) {
+    if(count == 0 || !reserveBatchScratch(count)) {
+        return;
+    }
+
+    BatchScratch* scratch = &batchScratch;
+    int64_t started = latencyStart();
+    groupByShard(sharded, &entries[0].key, sizeof(BatchPut), count);
+
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        uint32_t first = scratch->starts[shardIndex];
+        uint32_t last = scratch->starts[shardIndex + 1];
+        if(first == last) {
+            continue;
+        }
+
+        CacheShard* shard = &sharded->shards[shardIndex];
+        pthread_rwlock_wrlock(&shard->lock);
+        drainReadBuffers(shard);
+        for(uint32_t position = first; position < last; position++) {
+            prefetchSlot(shard->cache, scratch->hashes[scratch->order[position]]);
+        }
+        for(uint32_t position = first; position < last; position++) {
+            const BatchPut* entry = &entries[scratch->order[position]];
+            putValue(shard->cache, entry->key, entry->value, entry->length, entry->ttlMs);
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    recordLatency(sharded, 1, started, count);
+}
+
+static InFlightLoad* findLoad(CacheShard* shard, int key) {
+    InFlightLoad* load = shard->loads;
+    while(load && load->key != key) {
+        load = load->next;
+    }
+    return load;
+}
+
+/* Drops one reference to a finished load, copying its result first when
+   handle is set. Caller holds shard->loadLock. */
+static void leaveLoad(InFlightLoad* load, ValueHandle* handle) {
+    if(handle) {
+        copyValue(&load->result, handle);
+    }
+    if(--load->references == 0) {
+        releaseValue(&load->result);
+        free(load);
+    }
+}
+
+static int needsRefresh(ShardedCache* sharded, const ValueHandle* handle) {
+    return sharded->refreshAheadMs > 0 && handle->expiresAt != 0 &&
+           handle->expiresAt - cacheNowMillis() <= sharded->refreshAheadMs;
+}
+
+/* Concurrent misses on one key share a single loader call: the first
+   caller loads while the rest wait on the shard's condition variable.
+   With refreshAheadMs set, the first reader to find an entry that close
+   to expiry reloads it, while everyone else keeps getting the current
+   value. Returns the value length or -1; release the handle after use. */
+int getOrLoad(ShardedCache* sharded, int key, CacheLoader loader, void* context, ValueHandle* handle) {
+    int length = shardedGetValue(sharded, key, handle);
+    if(length >= 0 && !needsRefresh(sharded, handle)) {
+        return length;
+    }
+    int refreshing = length >= 0;
+
+    CacheShard* shard = shardFor(sharded, key);
+    pthread_mutex_lock(&shard->loadLock);
+    InFlightLoad* load = findLoad(shard, key);
+    if(load) {
+        if(refreshing) {
+            pthread_mutex_unlock(&shard->loadLock);
+            return length;
+        }
+
+        load->references++;
+        while(!load->done) {
+            pthread_cond_wait(&shard->loadDone, &shard->loadLock);
+        }
+        leaveLoad(load, handle);
+        pthread_mutex_unlock(&shard->loadLock);
+        return handle->length;
+    }
+
+    load = (InFlightLoad*)calloc(1, sizeof(InFlightLoad));
+    if(!load) {
+        pthread_mutex_unlock(&shard->loadLock);
+        printf("Memory allocation failed\n");
+        return length;
+    }
+    load->key = key;
+    load->references = 1;
+    load->result.length = -1;
+    load->next = shard->loads;
+    shard->loads = load;
+    pthread_mutex_unlock(&shard->loadLock);
+
+    ValueHandle result;
+    if(refreshing || shardedGetValue(sharded, key, &result) < 0) {
+        long ttlMs = TTL_DEFAULT;
+        size_t loadedLength = 0;
+        char* loaded = loader(key, &loadedLength, &ttlMs, context);
+
+        result.length = -1;
+        result.buffer = NULL;
+        if(loaded) {
+            shardedPutValue(sharded, key, loaded, loadedLength, ttlMs);
+            makeDetachedValue(loaded, loadedLength, &result);
+            free(loaded);
+        }
+    }
+
+    pthread_mutex_lock(&shard->loadLock);
+    InFlightLoad** link = &shard->loads;
+    while(*link != load) {
+        link = &(*link)->next;
+    }
+    *link = load->next;
+    load->result = result;
+    load->done = 1;
+    pthread_cond_broadcast(&shard->loadDone);
+
+    if(refreshing && result.length < 0) {
+        leaveLoad(load, NULL);
+    } else {
+        if(refreshing) {
+            releaseValue(handle);
+        }
+        leaveLoad(load, handle);
+    }
+    pthread_mutex_unlock(&shard->loadLock);
+    return handle->length;
+}
+
+void shardedExpire(ShardedCache* sharded) {
+    int64_t now = cacheNowMillis();
+
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        CacheShard* shard = &sharded->shards[shardIndex];
+        if(__atomic_load_n(&shard->cache->timers.count, __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+        pthread_rwlock_wrlock(&shard->lock);
+        expireEntries(shard->cache, now);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
+
+static void collectProbeLengths(const HashSlot* slots, size_t mask, CacheStats* stats) {
+    if(!slots) {
+        return;
+    }
+
+    for(size_t slotIndex = 0; slotIndex <= mask; slotIndex++) {
+        if(slots[slotIndex].node == NULL || slots[slotIndex].node == HASH_TOMBSTONE) {
+            continue;
+        }
+
+        size_t probeLength = ((slotIndex - (hash(slots[slotIndex].key) & mask)) & mask) + 1;
+        stats->probeLengths[probeLength < PROBE_BUCKETS ? probeLength - 1 : PROBE_BUCKETS - 1]++;
+        if(probeLength > stats->maxProbe) {
+            stats->maxProbe = probeLength;
+        }
+    }
+}
+
+static void addShardStats(ShardStats* total, const ShardStats* shard) {
+    total->entries += shard->entries;
+    total->weight += shard->weight;
+    total->capacity += shard->capacity;
+    total->hits += shard->hits;
+    total->misses += shard->misses;
+    total->inserts += shard->inserts;
+    total->updates += shard->updates;
+    total->evictions += shard->evictions;
+    total->expirations += shard->expirations;
+}
+
+/* Merges every thread's counters with the per-shard write-side counters and
+   walks the hash index for probe lengths. Caller frees stats->shards. */
+int collectCacheStats(ShardedCache* sharded, CacheStats* stats) {
+    memset(stats, 0, sizeof(CacheStats));
+    stats->shards = (ShardStats*)calloc((size_t)sharded->shardCount, sizeof(ShardStats));
+    if(!stats->shards) {
+        printf("Memory allocation failed\n");
+        return 0;
+    }
+    stats->shardCount = sharded->shardCount;
+
+    shardedExpire(sharded);
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        CacheShard* shard = &sharded->shards[shardIndex];
+        ShardStats* shardStats = &stats->shards[shardIndex];
+        LRUCache* cache = shard->cache;
+
+        pthread_rwlock_rdlock(&shard->lock);
+        shardStats->entries = cache->size;
+        shardStats->weight = cache->weight;
+        shardStats->capacity = cache->capacity;
+        shardStats->hits = (uint64_t)cache->hits;
+        shardStats->misses = (uint64_t)cache->misses;
+        shardStats->inserts = (uint64_t)cache->inserts;
+        shardStats->updates = (uint64_t)cache->updates;
+        shardStats->evictions = (uint64_t)cache->evictions;
+        shardStats->expirations = (uint64_t)cache->expirations;
+        collectProbeLengths(cache->index.slots, cache->index.mask, stats);
+        collectProbeLengths(cache->index.oldSlots, cache->index.oldMask, stats);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    pthread_mutex_lock(&sharded->countersLock);
+    for(ThreadCounters* counters = sharded->counters; counters; counters = counters->next) {
+        for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+            stats->shards[shardIndex].hits += __atomic_load_n(&counters->shardCounters[2 * shardIndex],
+                                                              __ATOMIC_RELAXED);
+            stats->shards[shardIndex].misses += __atomic_load_n(&counters->shardCounters[2 * shardIndex + 1],
+                                                                __ATOMIC_RELAXED);
+        }
+        for(int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            stats->getLatency[bucket] += __atomic_load_n(&counters->getLatency[bucket], __ATOMIC_RELAXED);
+            stats->putLatency[bucket] += __atomic_load_n(&counters->putLatency[bucket], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&sharded->countersLock);
+
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        addShardStats(&stats->total, &stats->shards[shardIndex]);
+    }
+    return 1;
+}
+
+/* Upper bound in nanoseconds of the bucket holding the given fraction. */
+uint64_t latencyPercentile(const uint64_t* histogram, double fraction) {
+    uint64_t samples = 0;
+    for(int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        samples += histogram[bucket];
+    }
+    if(samples == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(fraction * (double)samples);
+    uint64_t seen = 0;
+    for(int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram[bucket];
+        if(seen > target) {
+            return (uint64_t)1 << bucket;
+        }
+    }
+    return (uint64_t)1 << (LATENCY_BUCKETS - 1);
+}
+
+static void printLatency(const char* name, const uint64_t* histogram) {
+    uint64_t samples = 0;
+    for(int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        samples += histogram[bucket];
+    }
+    printf("%s samples=%llu p50<=%lluns p99<=%lluns p999<=%lluns\n", name, (unsigned long long)samples,
+           (unsigned long long)latencyPercentile(histogram, 0.5),
+           (unsigned long long)latencyPercentile(histogram, 0.99),
+           (unsigned long long)latencyPercentile(histogram, 0.999));
+}
+
+void printCacheStats(ShardedCache* sharded) {
+    CacheStats stats;
+    if(!collectCacheStats(sharded, &stats)) {
+        return;
+    }
+
+    ShardStats* total = &stats.total;
+    uint64_t lookups = total->hits + total->misses;
+    printf("policy=%s entries=%ld %s=%zu/%zu hits=%llu misses=%llu hitRatio=%.2f%%\n",
+           policyNames[sharded->shards[0].cache->policy], total->entries,
+           sharded->shards[0].cache->byteBudget ? "bytes" : "weight", total->weight, total->capacity,
+           (unsigned long long)total->hits, (unsigned long long)total->misses,
+           lookups ? 100.0 * total->hits / lookups : 0.0);
+    printf("inserts=%llu updates=%llu evictions=%llu expirations=%llu\n", (unsigned long long)total->inserts,
+           (unsigned long long)total->updates, (unsigned long long)total->evictions,
+           (unsigned long long)total->expirations);
+
+    if(stats.shardCount > 1) {
+        for(int shardIndex = 0; shardIndex < stats.shardCount; shardIndex++) {
+            ShardStats* shard = &stats.shards[shardIndex];
+            printf("shard %d entries=%ld hits=%llu misses=%llu inserts=%llu updates=%llu evictions=%llu "
+                   "expirations=%llu\n", shardIndex, shard->entries, (unsigned long long)shard->hits,
+                   (unsigned long long)shard->misses, (unsigned long long)shard->inserts,
+                   (unsigned long long)shard->updates, (unsigned long long)shard->evictions,
+                   (unsigned long long)shard->expirations);
+        }
+    }
+
+    printLatency("getLatency", stats.getLatency);
+    printLatency("putLatency", stats.putLatency);
+
+    uint64_t probed = 0;
+    uint64_t probeSum = 0;
+    for(int bucket = 0; bucket < PROBE_BUCKETS; bucket++) {
+        probed += stats.probeLengths[bucket];
+        probeSum += stats.probeLengths[bucket] * (uint64_t)(bucket + 1);
+    }
+    printf("probeLength mean=%.2f max=%zu", probed ? (double)probeSum / probed : 0.0, stats.maxProbe);
+    for(int bucket = 0; bucket < PROBE_BUCKETS; bucket++) {
+        if(stats.probeLengths[bucket]) {
+            printf(" %d%s:%llu", bucket + 1, bucket == PROBE_BUCKETS - 1 ? "+" : "",
+                   (unsigned long long)stats.probeLengths[bucket]);
+        }
+    }
+    printf("\n");
+
+    free(stats.shards);
+}
+
+int parsePolicy(const char* name, EvictionPolicy* policy) {
+    for(int policyIndex = 0; policyIndex <= POLICY_TINYLFU; policyIndex++) {
+        if(strcasecmp(name, policyNames[policyIndex]) == 0) {
+            *policy = (EvictionPolicy)policyIndex;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int parseByteSize(const char* text, size_t* bytes) {
+    char* end = NULL;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if(end == text) {
+        return 0;
+    }
+    switch(tolower((unsigned char)*end)) {
+        case 'g':
+            value <<= 10;
+            /* fall through */
+        case 'm':
+            value <<= 10;
+            /* fall through */
+        case 'k':
+            value <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if(*end != '\0') {
+        return 0;
+    }
+
+    *bytes = (size_t)value;
+    return 1;
+}
+
+int parseCacheOption(CacheConfig* config, const char* option) {
+    if(isdigit((unsigned char)option[0])) {
+        config->shardCount = atoi(option);
+        return 1;
+    }
+    if(strncmp(option, "shards=", 7) == 0) {
+        config->shardCount = atoi(option + 7);
+        return config->shardCount > 0;
+    }
+    if(strncmp(option, "capacity=", 9) == 0) {
+        config->capacity = atoi(option + 9);
+        return config->capacity > 0;
+    }
+    if(strncmp(option, "policy=", 7) == 0) {
+        return parsePolicy(option + 7, &config->policy);
+    }
+    if(strncmp(option, "refresh=", 8) == 0) {
+        config->refreshAheadMs = atol(option + 8);
+        return config->refreshAheadMs >= 0;
+    }
+    if(strncmp(option, "ttl=", 4) == 0) {
+        config->defaultTtlMs = atol(option + 4);
+        return config->defaultTtlMs >= 0;
+    }
+    if(strncmp(option, "bytes=", 6) == 0) {
+        return parseByteSize(option + 6, &config->maxBytes);
+    }
+    return 0;
+}
+
+static int64_t wallClockMillis(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int copyShardSnapshot(CacheShard* shard, SnapshotBuffer* out, int64_t now) {
+    static const Segment order[] = { SEG_FREQUENT, SEG_RECENT, SEG_PROBATION };
+    int copied = 1;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    drainReadBuffers(shard);
+    pthread_rwlock_unlock(&shard->lock);
+
+    pthread_rwlock_rdlock(&shard->lock);
+    for(int orderIndex = 0; orderIndex < 3 && copied; orderIndex++) {
+        for(Node* node = shard->cache->lists[order[orderIndex]].head; node; node = node->next) {
+            if(isExpired(node, now)) {
+                continue;
+            }
+            if(!growBuffer(&out->data, &out->capacity, out->length + SNAPSHOT_RECORD_HEADER + node->valueLength)) {
+                copied = 0;
+                break;
+            }
+
+            int32_t key = node->key;
+            int64_t ttlMs = node->expiresAt ? node->expiresAt - now : 0;
+            uint8_t segment = node->segment;
+            char* record = out->data + out->length;
+            memcpy(record, &key, 4);
+            memcpy(record + 4, &node->valueLength, 4);
+            memcpy(record + 8, &ttlMs, 8);
+            memcpy(record + 16, &segment, 1);
+            memcpy(record + SNAPSHOT_RECORD_HEADER, nodeValue(node), node->valueLength);
+            out->length += SNAPSHOT_RECORD_HEADER + node->valueLength;
+            out->records++;
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    if(!copied) {
+        printf("Memory allocation failed\n");
+    }
+    return copied;
+}
+
+static int syncParentDirectory(const char* path) {
+    char directory[4096];
+    const char* slash = strrchr(path, '/');
+
+    if(!slash) {
+        strcpy(directory, ".");
+    } else if(slash == path) {
+        strcpy(directory, "/");
+    } else {
+        size_t length = (size_t)(slash - path);
+        if(length >= sizeof(directory)) {
+            return 0;
+        }
+        memcpy(directory, path, length);
+        directory[length] = '\0';
+    }
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) {
+        return 0;
+    }
+    int synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+static int writeSnapshotFile(SnapshotBuffer* buffers, int shardCount, uint64_t total, uint32_t policy,
+                             const char* path) {
+    char tempPath[4096];
+    if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath)) {
+        printf("Snapshot path too long\n");
+        return 0;
+    }
+
+    FILE* file = fopen(tempPath, "wb");
+    if(!file) {
+        printf("Could not write snapshot %s: %s\n", tempPath, strerror(errno));
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, SNAPSHOT_WRITE_BUFFER);
+
+    char header[SNAPSHOT_HEADER_SIZE];
+    uint32_t version = SNAPSHOT_VERSION;
+    int64_t savedAt = wallClockMillis();
+    memcpy(header, SNAPSHOT_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &policy, 4);
+    memcpy(header + 16, &savedAt, 8);
+    memcpy(header + 24, &total, 8);
+    int written = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    for(uint64_t remaining = total; remaining > 0 && written;) {
+        for(int shardIndex = 0; shardIndex < shardCount && written; shardIndex++) {
+            SnapshotBuffer* buffer = &buffers[shardIndex];
+            if(buffer->cursor == buffer->length) {
+                continue;
+            }
+
+            uint32_t valueLength;
+            memcpy(&valueLength, buffer->data + buffer->cursor + 4, 4);
+            size_t recordLength = SNAPSHOT_RECORD_HEADER + valueLength;
+            written = fwrite(buffer->data + buffer->cursor, 1, recordLength, file) == recordLength;
+            buffer->cursor += recordLength;
+            remaining--;
+        }
+    }
+
+    written = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = fclose(file) == 0 && written;
+    if(!written || rename(tempPath, path) != 0) {
+        printf("Could not write snapshot %s: %s\n", path, strerror(errno));
+        unlink(tempPath);
+        return 0;
+    }
+    syncParentDirectory(path);
+    return 1;
+}
+
+/* Each shard is copied under its read lock, so writers only wait for one
+   shard's memcpy. Records from all shards are then interleaved round-robin,
+   keeping the file hottest-first, and written to <path>.tmp which is fsynced
+   and renamed over <path>. Returns the number of entries saved or -1. */
+long saveSnapshot(ShardedCache* sharded, const char* path) {
+    SnapshotBuffer* buffers = (SnapshotBuffer*)calloc((size_t)sharded->shardCount, sizeof(SnapshotBuffer));
+    if(!buffers) {
+        printf("Memory allocation failed\n");
+        return -1;
+    }
+
+    int64_t now = cacheNowMillis();
+    uint64_t total = 0;
+    int copied = 1;
+    for(int shardIndex = 0; shardIndex < sharded->shardCount && copied; shardIndex++) {
+        copied = copyShardSnapshot(&sharded->shards[shardIndex], &buffers[shardIndex], now);
+        total += buffers[shardIndex].records;
+    }
+
+    long saved = -1;
+    if(copied && writeSnapshotFile(buffers, sharded->shardCount, total,
+                                   (uint32_t)sharded->shards[0].cache->policy, path)) {
+        saved = (long)total;
+    }
+
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        free(buffers[shardIndex].data);
+    }
+    free(buffers);
+    return saved;
+}
+
+/* Streams records straight out of the mapped file in the order they were
+   saved, so the hottest entries of every shard land first and shards that
+   fill up stop accepting the colder tail. Returns entries restored or -1. */
+long loadSnapshot(ShardedCache* sharded, const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        printf("Could not open snapshot %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < SNAPSHOT_HEADER_SIZE) {
+        printf("Invalid snapshot %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    const char* data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        printf("Could not map snapshot %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    uint32_t version;
+    int64_t savedAt;
+    uint64_t count;
+    memcpy(&version, data + 8, 4);
+    memcpy(&savedAt, data + 16, 8);
+    memcpy(&count, data + 24, 8);
+    if(memcmp(data, SNAPSHOT_MAGIC, 8) != 0 || version != SNAPSHOT_VERSION) {
+        printf("Invalid snapshot %s\n", path);
+        munmap((void*)data, size);
+        return -1;
+    }
+
+    int64_t elapsed = wallClockMillis() - savedAt;
+    if(elapsed < 0) {
+        elapsed = 0;
+    }
+
+    char fullShards[MAX_SHARDS] = { 0 };
+    int fullCount = 0;
+    long restored = 0;
+    size_t offset = SNAPSHOT_HEADER_SIZE;
+    for(uint64_t recordIndex = 0; recordIndex < count && fullCount < sharded->shardCount; recordIndex++) {
+        int32_t key;
+        uint32_t valueLength;
+        int64_t ttlMs;
+        uint8_t segment;
+
+        if(size - offset < SNAPSHOT_RECORD_HEADER) {
+            break;
+        }
+        memcpy(&key, data + offset, 4);
+        memcpy(&valueLength, data + offset + 4, 4);
+        memcpy(&ttlMs, data + offset + 8, 8);
+        memcpy(&segment, data + offset + 16, 1);
+        offset += SNAPSHOT_RECORD_HEADER;
+        if(size - offset < valueLength) {
+            break;
+        }
+        const char* value = data + offset;
+        offset += valueLength;
+
+        if(ttlMs != 0) {
+            ttlMs -= elapsed;
+            if(ttlMs <= 0) {
+                continue;
+            }
+        }
+
+        CacheShard* shard = shardFor(sharded, key);
+        int shardIndex = (int)(shard - sharded->shards);
+        if(fullShards[shardIndex]) {
+            continue;
+        }
+
+        pthread_rwlock_wrlock(&shard->lock);
+        drainReadBuffers(shard);
+        int result = restoreEntry(shard->cache, key, value, valueLength,
+                                  segment < SEG_GHOST_RECENT ? (Segment)segment : SEG_RECENT, (long)ttlMs);
+        pthread_rwlock_unlock(&shard->lock);
+
+        if(result > 0) {
+            restored++;
+        } else if(result < 0) {
+            fullShards[shardIndex] = 1;
+            fullCount++;
+        }
+    }
+
+    munmap((void*)data, size);
+    return restored;
+}
+
+void freeShardedCache(ShardedCache* sharded) {
+    if(!sharded) {
+        return;
+    }
+
+    for(int shardIndex = 0; shardIndex < sharded->shardCount; shardIndex++) {
+        freeCache(sharded->shards[shardIndex].cache);
+        pthread_rwlock_destroy(&sharded->shards[shardIndex].lock);
+        pthread_mutex_destroy(&sharded->shards[shardIndex].loadLock);
+        pthread_cond_destroy(&sharded->shards[shardIndex].loadDone);
+    }
+
+    ThreadCounters* counters = sharded->counters;
+    while(counters) {
+        ThreadCounters* next = counters->next;
+        free(counters);
+        counters = next;
+    }
+    pthread_mutex_destroy(&sharded->countersLock);
+
+    free(sharded->shards);
+    free(sharded);
+}
+
+typedef struct Connection {
+    int fd;
+    int closing;
+    uint32_t events;
+
+    char* input;
+    size_t inputLength;
+    size_t inputCapacity;
+
+    char* output;
+    size_t outputLength;
+    size_t outputSent;
+    size_t outputCapacity;
+} Connection;
+
+typedef struct ServerLoop {
+    ShardedCache* cache;
+    int port;
+    int listenFd;
+    int epollFd;
+    int expiresCache;
+    int* batchKeys;
+    ValueHandle* batchResults;
+    size_t batchCapacity;
+} ServerLoop;
+
+static volatile sig_atomic_t serverStopping = 0;
+
+static void stopServer(int signalNumber) {
+    (void)signalNumber;
+    serverStopping = 1;
+}
+
+static void appendOutput(Connection* conn, const char* data, size_t length) {
+    if(!growBuffer(&conn->output, &conn->outputCapacity, conn->outputLength + length)) {
+        conn->closing = 1;
+        return;
+    }
+    memcpy(conn->output + conn->outputLength, data, length);
+    conn->outputLength += length;
+}
+
+static void appendText(Connection* conn, const char* text) {
+    appendOutput(conn, text, strlen(text));
+}
+
+static const char* nextToken(const char** cursor, const char* end, size_t* length) {
+    const char* start = *cursor;
+
+    while(start < end && (*start == ' ' || *start == '\t')) {
+        start++;
+    }
+
+    const char* stop = start;
+    while(stop < end && *stop != ' ' && *stop != '\t') {
+        stop++;
+    }
+
+    *cursor = stop;
+    *length = (size_t)(stop - start);
+    return *length ? start : NULL;
+}
+
+static int tokenEquals(const char* token, size_t length, const char* word) {
+    return token && strlen(word) == length && memcmp(token, word, length) == 0;
+}
+
+static int parseLongToken(const char* token, size_t length, long* value) {
+    char number[32];
+
+    if(!token || length == 0 || length >= sizeof(number)) {
+        return 0;
+    }
+    memcpy(number, token, length);
+    number[length] = '\0';
+
+    char* end = NULL;
+    errno = 0;
+    *value = strtol(number, &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+static int parseKeyToken(const char* token, size_t length, int* key) {
+    long value;
+
+    if(!parseLongToken(token, length, &value) || value < INT32_MIN || value > INT32_MAX) {
+        return 0;
+    }
+    *key = (int)value;
+    return 1;
+}
+
+static long exptimeToTtl(long exptime) {
+    if(exptime == 0) {
+        return 0;
+    }
+    if(exptime > MEMCACHED_RELATIVE_EXPTIME_LIMIT) {
+        exptime -= (long)time(NULL);
+    }
+    return exptime > 0 ? exptime * 1000 : -1;
+}
+
+static int reserveServerBatch(ServerLoop* loop, size_t count) {
+    if(count <= loop->batchCapacity) {
+        return 1;
+    }
+
+    size_t capacity = loop->batchCapacity ? loop->batchCapacity * 2 : 64;
+    while(capacity < count) {
+        capacity *= 2;
+    }
+
+    int* keys = (int*)realloc(loop->batchKeys, capacity * sizeof(int));
+    if(keys) {
+        loop->batchKeys = keys;
+    }
+    ValueHandle* results = (ValueHandle*)realloc(loop->batchResults, capacity * sizeof(ValueHandle));
+    if(results) {
+        loop->batchResults = results;
+    }
+    if(!keys || !results) {
+        return 0;
+    }
+    loop->batchCapacity = capacity;
+    return 1;
+}
+
+static void handleGet(ServerLoop* loop, Connection* conn, const char* cursor, const char* end) {
+    size_t length;
+    size_t keyCount = 0;
+    const char* token;
+    char header[64];
+
+    while((token = nextToken(&cursor, end, &length)) != NULL) {
+        int key;
+        if(!parseKeyToken(token, length, &key)) {
+            continue;
+        }
+        if(!reserveServerBatch(loop, keyCount + 1)) {
+            conn->closing = 1;
+            return;
+        }
+        loop->batchKeys[keyCount++] = key;
+    }
+
+    shardedMultiGet(loop->cache, loop->batchKeys, keyCount, loop->batchResults);
+
+    for(size_t keyIndex = 0; keyIndex < keyCount; keyIndex++) {
+        ValueHandle* result = &loop->batchResults[keyIndex];
+        if(result->length < 0) {
+            continue;
+        }
+
+        int headerLength = snprintf(header, sizeof(header), "VALUE %d 0 %d\r\n", loop->batchKeys[keyIndex],
+                                    result->length);
+        appendOutput(conn, header, (size_t)headerLength);
+        appendOutput(conn, valueData(result), (size_t)result->length);
+        appendOutput(conn, "\r\n", 2);
+        releaseValue(result);
+    }
+    appendText(conn, "END\r\n");
+}
+
+static size_t handleSet(ServerLoop* loop, Connection* conn, const char* cursor, const char* end,
+                        const char* data, size_t available) {
+    size_t length;
+    const char* keyToken = nextToken(&cursor, end, &length);
+    size_t keyLength = length;
+    const char* flagsToken = nextToken(&cursor, end, &length);
+    const char* exptimeToken = nextToken(&cursor, end, &length);
+    size_t exptimeLength = length;
+    const char* bytesToken = nextToken(&cursor, end, &length);
+    size_t bytesLength = length;
+    const char* noreplyToken = nextToken(&cursor, end, &length);
+    int noreply = tokenEquals(noreplyToken, length, "noreply");
+
+    long exptime = 0;
+    long bytes = 0;
+    if(!flagsToken || !parseLongToken(exptimeToken, exptimeLength, &exptime) ||
+       !parseLongToken(bytesToken, bytesLength, &bytes) || bytes < 0 || bytes > SERVER_MAX_VALUE) {
+        appendText(conn, "CLIENT_ERROR bad command line format\r\n");
+        conn->closing = bytes > SERVER_MAX_VALUE;
+        return 0;
+    }
+
+    if(available < (size_t)bytes + 2) {
+        return (size_t)-1;
+    }
+
+    int key;
+    if(!parseKeyToken(keyToken, keyLength, &key)) {
+        appendText(conn, "CLIENT_ERROR key must be an integer\r\n");
+    } else if(data[bytes] != '\r' || data[bytes + 1] != '\n') {
+        appendText(conn, "CLIENT_ERROR bad data chunk\r\n");
+    } else {
+        long ttlMs = exptimeToTtl(exptime);
+        if(ttlMs < 0) {
+            shardedDelete(loop->cache, key);
+        } else {
+            shardedPutValue(loop->cache, key, data, (size_t)bytes, ttlMs);
+        }
+        if(!noreply) {
+            appendText(conn, "STORED\r\n");
+        }
+    }
+    return (size_t)bytes + 2;
+}
+
+static void handleDelete(ServerLoop* loop, Connection* conn, const char* cursor, const char* end) {
+    size_t length;
+    const char* keyToken = nextToken(&cursor, end, &length);
+    size_t keyLength = length;
+    const char* noreplyToken = nextToken(&cursor, end, &length);
+    int noreply = tokenEquals(noreplyToken, length, "noreply");
+
+    int key;
+    if(!parseKeyToken(keyToken, keyLength, &key)) {
+        appendText(conn, "CLIENT_ERROR key must be an integer\r\n");
+        return;
+    }
+
+    int removed = shardedDelete(loop->cache, key);
+    if(!noreply) {
+        appendText(conn, removed ? "DELETED\r\n" : "NOT_FOUND\r\n");
+    }
+}
+
+static void appendStat(Connection* conn, const char* name, unsigned long long value) {
+    char line[128];
+    int length = snprintf(line, sizeof(line), "STAT %s %llu\r\n", name, value);
+    appendOutput(conn, line, (size_t)length);
+}
+
+static void handleStats(ServerLoop* loop, Connection* conn) {
+    CacheStats stats;
+    if(!collectCacheStats(loop->cache, &stats)) {
+        appendText(conn, "SERVER_ERROR out of memory\r\n");
+        return;
+    }
+
+    ShardStats* total = &stats.total;
+    appendStat(conn, "curr_items", (unsigned long long)total->entries);
+    appendStat(conn, loop->cache->shards[0].cache->byteBudget ? "bytes" : "weight", total->weight);
+    appendStat(conn, loop->cache->shards[0].cache->byteBudget ? "limit_maxbytes" : "limit_entries", total->capacity);
+    appendStat(conn, "get_hits", total->hits);
+    appendStat(conn, "get_misses", total->misses);
+    appendStat(conn, "total_items", total->inserts);
+    appendStat(conn, "updates", total->updates);
+    appendStat(conn, "evictions", total->evictions);
+    appendStat(conn, "expirations", total->expirations);
+    appendStat(conn, "get_latency_p50_ns", latencyPercentile(stats.getLatency, 0.5));
+    appendStat(conn, "get_latency_p99_ns", latencyPercentile(stats.getLatency, 0.99));
+    appendStat(conn, "get_latency_p999_ns", latencyPercentile(stats.getLatency, 0.999));
+    appendStat(conn, "set_latency_p50_ns", latencyPercentile(stats.putLatency, 0.5));
+    appendStat(conn, "set_latency_p99_ns", latencyPercentile(stats.putLatency, 0.99));
+    appendStat(conn, "set_latency_p999_ns", latencyPercentile(stats.putLatency, 0.999));
+    appendStat(conn, "probe_length_max", stats.maxProbe);
+
+    char name[64];
+    for(int bucket = 0; bucket < PROBE_BUCKETS; bucket++) {
+        snprintf(name, sizeof(name), "probe_length_%d%s", bucket + 1, bucket == PROBE_BUCKETS - 1 ? "_plus" : "");
+        appendStat(conn, name, stats.probeLengths[bucket]);
+    }
+    for(int shardIndex = 0; shardIndex < stats.shardCount; shardIndex++) {
+        ShardStats* shard = &stats.shards[shardIndex];
+        snprintf(name, sizeof(name), "shard_%d_hits", shardIndex);
+        appendStat(conn, name, shard->hits);
+        snprintf(name, sizeof(name), "shard_%d_misses", shardIndex);
+        appendStat(conn, name, shard->misses);
+        snprintf(name, sizeof(name), "shard_%d_evictions", shardIndex);
+        appendStat(conn, name, shard->evictions);
+    }
+    appendText(conn, "END\r\n");
+    free(stats.shards);
+}
+
+static void processInput(ServerLoop* loop, Connection* conn) {
+    size_t offset = 0;
+
+    while(offset < conn->inputLength && !conn->closing) {
+        char* line = conn->input + offset;
+        char* newline = (char*)memchr(line, '\n', conn->inputLength - offset);
+        if(!newline) {
+            if(conn->inputLength - offset > SERVER_MAX_LINE) {
+                appendText(conn, "CLIENT_ERROR line too long\r\n");
+                conn->closing = 1;
+            }
+            break;
+        }
+
+        const char* end = newline;
+        if(end > line && end[-1] == '\r') {
+            end--;
+        }
+        size_t consumed = (size_t)(newline - line) + 1;
+
+        const char* cursor = line;
+        size_t length;
+        const char* command = nextToken(&cursor, end, &length);
+
+        if(!command) {
+            appendText(conn, "ERROR\r\n");
+        } else if(tokenEquals(command, length, "get")) {
+            handleGet(loop, conn, cursor, end);
+        } else if(tokenEquals(command, length, "set")) {
+            size_t dataLength = handleSet(loop, conn, cursor, end, newline + 1,
+                                          conn->inputLength - offset - consumed);
+            if(dataLength == (size_t)-1) {
+                break;
+            }
+            consumed += dataLength;
+        } else if(tokenEquals(command, length, "delete")) {
+            handleDelete(loop, conn, cursor, end);
+        } else if(tokenEquals(command, length, "stats")) {
+            handleStats(loop, conn);
+        } else if(tokenEquals(command, length, "version")) {
+            appendText(conn, "VERSION lruCacheManagement\r\n");
+        } else if(tokenEquals(command, length, "quit")) {
+            conn->closing = 1;
+        } else {
+            appendText(conn, "ERROR\r\n");
+        }
+        offset += consumed;
+    }
+
+    if(offset > 0) {
+        memmove(conn->input, conn->input + offset, conn->inputLength - offset);
+        conn->inputLength -= offset;
+    }
+}
+
+static void closeConnection(ServerLoop* loop, Connection* conn) {
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->input);
+    free(conn->output);
+    free(conn);
+}
+
+static int flushOutput(ServerLoop* loop, Connection* conn) {
+    while(conn->outputSent < conn->outputLength) {
+        ssize_t sent = send(conn->fd, conn->output + conn->outputSent,
+                            conn->outputLength - conn->outputSent, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return 0;
+        }
+        conn->outputSent += (size_t)sent;
+    }
+
+    if(conn->outputSent == conn->outputLength) {
+        conn->outputSent = 0;
+        conn->outputLength = 0;
+    }
+
+    uint32_t wanted = EPOLLIN | (conn->outputLength ? EPOLLOUT : 0);
+    if(wanted != conn->events) {
+        struct epoll_event event = { .events = wanted, .data.ptr = conn };
+        epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = wanted;
+    }
+    return 1;
+}
+
+static void readConnection(ServerLoop* loop, Connection* conn) {
+    while(!conn->closing) {
+        if(!growBuffer(&conn->input, &conn->inputCapacity, conn->inputLength + SERVER_READ_CHUNK)) {
+            conn->closing = 1;
+            break;
+        }
+
+        ssize_t received = recv(conn->fd, conn->input + conn->inputLength, SERVER_READ_CHUNK, 0);
+        if(received < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn->closing = 1;
+            }
+            break;
+        }
+        if(received == 0) {
+            conn->closing = 1;
+            break;
+        }
+
+        conn->inputLength += (size_t)received;
+        processInput(loop, conn);
+        if(received < SERVER_READ_CHUNK) {
+            break;
+        }
+    }
+}
+
+static void acceptConnections(ServerLoop* loop) {
+    while(1) {
+        int fd = accept4(loop->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+        if(!conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+        if(epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+static int openListener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((uint16_t)port);
+
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void* runServerLoop(void* argument) {
+    ServerLoop* loop = (ServerLoop*)argument;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int64_t nextExpiry = cacheNowMillis() + SERVER_EXPIRE_INTERVAL_MS;
+
+    while(!serverStopping) {
+        int ready = epoll_wait(loop->epollFd, events, SERVER_MAX_EVENTS, SERVER_EXPIRE_INTERVAL_MS);
+        if(ready < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        for(int eventIndex = 0; eventIndex < ready; eventIndex++) {
+            if(events[eventIndex].data.ptr == NULL) {
+                acceptConnections(loop);
+                continue;
+            }
+
+            Connection* conn = (Connection*)events[eventIndex].data.ptr;
+            if(events[eventIndex].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readConnection(loop, conn);
+            }
+            if(!flushOutput(loop, conn) || (conn->closing && conn->outputLength == 0)) {
+                closeConnection(loop, conn);
+            }
+        }
+
+        if(loop->expiresCache && cacheNowMillis() >= nextExpiry) {
+            shardedExpire(loop->cache);
+            nextExpiry = cacheNowMillis() + SERVER_EXPIRE_INTERVAL_MS;
+        }
+    }
+    return NULL;
+}
+
+typedef struct SnapshotSchedule {
+    ShardedCache* cache;
+    const char* path;
+    long intervalSeconds;
+} SnapshotSchedule;
+
+static void* runSnapshotLoop(void* argument) {
+    SnapshotSchedule* schedule = (SnapshotSchedule*)argument;
+    int64_t nextSnapshot = cacheNowMillis() + schedule->intervalSeconds * 1000;
+
+    while(!serverStopping) {
+        usleep(SNAPSHOT_POLL_MS * 1000);
+        if(cacheNowMillis() >= nextSnapshot) {
+            saveSnapshot(schedule->cache, schedule->path);
+            nextSnapshot = cacheNowMillis() + schedule->intervalSeconds * 1000;
+        }
+    }
+    return NULL;
+}
+
+int runServer(int argc, char** argv) {
+    CacheConfig config = { .capacity = 65536, .shardCount = 16, .policy = POLICY_LRU };
+    int port = SERVER_DEFAULT_PORT;
+    int threads = 1;
+    SnapshotSchedule schedule = { NULL, NULL, 0 };
+    pthread_t snapshotThread;
+    int snapshotThreadStarted = 0;
+
+    for(int argIndex = 0; argIndex < argc; argIndex++) {
+        const char* option = argv[argIndex];
+        if(strncmp(option, "port=", 5) == 0) {
+            port = atoi(option + 5);
+        } else if(strncmp(option, "threads=", 8) == 0) {
+            threads = atoi(option + 8);
+        } else if(strncmp(option, "snapshot=", 9) == 0) {
+            schedule.path = option + 9;
+        } else if(strncmp(option, "snapshotInterval=", 17) == 0) {
+            schedule.intervalSeconds = atol(option + 17);
+        } else if(!parseCacheOption(&config, option)) {
+            printf("Invalid option %s\n", option);
+            return 1;
+        }
+    }
+    if(threads < 1) {
+        threads = 1;
+    }
+
+    ShardedCache* cache = createShardedCache(&config);
+    if(!cache) {
+        return 1;
+    }
+    if(schedule.path && access(schedule.path, F_OK) == 0) {
+        long restored = loadSnapshot(cache, schedule.path);
+        if(restored >= 0) {
+            printf("Restored %ld entries from %s\n", restored, schedule.path);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+
+    ServerLoop* loops = (ServerLoop*)calloc((size_t)threads, sizeof(ServerLoop));
+    pthread_t* workers = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+    if(!loops || !workers) {
+        printf("Memory allocation failed\n");
+        free(loops);
+        free(workers);
+        freeShardedCache(cache);
+        return 1;
+    }
+
+    int started = 0;
+    for(; started < threads; started++) {
+        ServerLoop* loop = &loops[started];
+        loop->cache = cache;
+        loop->port = port;
+        loop->expiresCache = started == 0;
+        loop->listenFd = openListener(port);
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(loop->listenFd < 0 || loop->epollFd < 0) {
+            break;
+        }
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &event);
+        if(started > 0 && pthread_create(&workers[started], NULL, runServerLoop, loop) != 0) {
+            break;
+        }
+    }
+
+    if(started == threads) {
+        printf("Cache server listening on port %d with %d thread(s)\n", port, threads);
+        fflush(stdout);
+        if(schedule.path && schedule.intervalSeconds > 0) {
+            schedule.cache = cache;
+            snapshotThreadStarted = pthread_create(&snapshotThread, NULL, runSnapshotLoop, &schedule) == 0;
+        }
+        runServerLoop(&loops[0]);
+    }
+    serverStopping = 1;
+
+    for(int loopIndex = 1; loopIndex < started; loopIndex++) {
+        pthread_join(workers[loopIndex], NULL);
+    }
+    if(snapshotThreadStarted) {
+        pthread_join(snapshotThread, NULL);
+    }
+    if(schedule.path && started == threads) {
+        long saved = saveSnapshot(cache, schedule.path);
+        if(saved >= 0) {
+            printf("Saved %ld entries to %s\n", saved, schedule.path);
+        }
+    }
+    for(int loopIndex = 0; loopIndex < threads; loopIndex++) {
+        if(loops[loopIndex].listenFd > 0) {
+            close(loops[loopIndex].listenFd);
+        }
+        if(loops[loopIndex].epollFd > 0) {
+            close(loops[loopIndex].epollFd);
+        }
+        free(loops[loopIndex].batchKeys);
+        free(loops[loopIndex].batchResults);
+    }
+
+    free(loops);
+    free(workers);
+    freeShardedCache(cache);
+    return started == threads ? 0 : 1;
+}
+
+typedef enum BenchWorkload {
+    WORKLOAD_ZIPF,
+    WORKLOAD_UNIFORM,
+    WORKLOAD_SCAN,
+    WORKLOAD_TRACE
+} BenchWorkload;
+
+typedef struct BenchConfig {
+    BenchWorkload workload;
+    const char* tracePath;
+    int keyCount;
+    long operations;
+    int threads;
+    int shardCount;
+    double zipfTheta;
+    int scanLength;
+    size_t valueSize;
+    long loadCostUs;
+    uint64_t seed;
+    int capacities[BENCH_MAX_CAPACITIES];
+    int capacityCount;
+    EvictionPolicy policies[POLICY_TINYLFU + 1];
+    int policyCount;
+    int batchSize;
+} BenchConfig;
+
+typedef struct BenchLoader {
+    const char* value;
+    size_t valueLength;
+    long costUs;
+    uint64_t calls;
+} BenchLoader;
+
+typedef struct BenchWorker {
+    ShardedCache* cache;
+    BenchLoader* loader;
+    const int* keys;
+    size_t keyCount;
+    int threadIndex;
+    int threads;
+    const char* value;
+    size_t valueLength;
+    int batchSize;
+    pthread_barrier_t* start;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t latency[BENCH_LATENCY_BUCKETS];
+} BenchWorker;
+
+static const char* workloadNames[] = { "zipf", "uniform", "scan", "trace" };
+
+static uint64_t benchRandom(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static int zipfKey(const double* cdf, int keyCount, double sample) {
+    int low = 0;
+    int high = keyCount - 1;
+
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+        if(cdf[middle] < sample) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static double* buildZipfTable(int keyCount, double theta) {
+    double* cdf = (double*)malloc((size_t)keyCount * sizeof(double));
+    if(!cdf) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+
+    double total = 0;
+    for(int rank = 0; rank < keyCount; rank++) {
+        total += 1.0 / pow(rank + 1, theta);
+        cdf[rank] = total;
+    }
+    for(int rank = 0; rank < keyCount; rank++) {
+        cdf[rank] /= total;
+    }
+    return cdf;
+}
+
+/* Takes the first integer on each line; lines without one are skipped. */
+static int* loadTrace(const char* path, size_t* count) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        printf("Could not open trace %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    size_t capacity = 1 << 16;
+    size_t used = 0;
+    int* keys = (int*)malloc(capacity * sizeof(int));
+    char line[256];
+    while(keys && fgets(line, sizeof(line), file)) {
+        char* cursor = line;
+        while(*cursor == ' ' || *cursor == '\t') {
+            cursor++;
+        }
+        char* end = NULL;
+        long key = strtol(cursor, &end, 10);
+        if(end == cursor) {
+            continue;
+        }
+
+        if(used == capacity) {
+            capacity *= 2;
+            int* grown = (int*)realloc(keys, capacity * sizeof(int));
+            if(!grown) {
+                free(keys);
+                keys = NULL;
+                break;
+            }
+            keys = grown;
+        }
+        keys[used++] = (int)key;
+    }
+    fclose(file);
+
+    if(!keys) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+    *count = used;
+    return keys;
+}
+
+/* Scan-mixed streams replace every BENCH_SCAN_PERIOD-th block of scanLength
+   operations with a sequential run over keys that are never reused. */
+static int* generateKeys(const BenchConfig* config, size_t* count) {
+    if(config->workload == WORKLOAD_TRACE) {
+        return loadTrace(config->tracePath, count);
+    }
+
+    int* keys = (int*)malloc((size_t)config->operations * sizeof(int));
+    if(!keys) {
+        printf("Memory allocation failed\n");
+        return NULL;
+    }
+
+    double* cdf = NULL;
+    if(config->workload != WORKLOAD_UNIFORM) {
+        cdf = buildZipfTable(config->keyCount, config->zipfTheta);
+        if(!cdf) {
+            free(keys);
+            return NULL;
+        }
+    }
+
+    uint64_t state = config->seed ? config->seed : 1;
+    int scanKey = config->keyCount;
+    for(long operation = 0; operation < config->operations; operation++) {
+        uint64_t random = benchRandom(&state);
+        if(config->workload == WORKLOAD_UNIFORM) {
+            keys[operation] = (int)(random % (uint64_t)config->keyCount);
+        } else if(config->workload == WORKLOAD_SCAN &&
+                  (operation / config->scanLength) % BENCH_SCAN_PERIOD == BENCH_SCAN_PERIOD - 1) {
+            keys[operation] = scanKey++;
+        } else {
+            keys[operation] = zipfKey(cdf, config->keyCount, (double)(random >> 11) / (double)(1ULL << 53));
+        }
+    }
+
+    free(cdf);
+    *count = (size_t)config->operations;
+    return keys;
+}
+
+/* Log-linear buckets: 2^BENCH_LATENCY_SUB_BITS linear steps per power of two. */
+static int benchLatencyBucket(uint64_t nanos) {
+    if(nanos < (1 << BENCH_LATENCY_SUB_BITS)) {
+        return (int)nanos;
+    }
+
+    int highBit = 63 - __builtin_clzll(nanos);
+    int shift = highBit - BENCH_LATENCY_SUB_BITS;
+    int step = (int)((nanos >> shift) & ((1 << BENCH_LATENCY_SUB_BITS) - 1));
+    return ((shift + 1) << BENCH_LATENCY_SUB_BITS) + step;
+}
+
+static uint64_t benchBucketLimit(int bucket) {
+    if(bucket < (1 << BENCH_LATENCY_SUB_BITS)) {
+        return (uint64_t)bucket;
+    }
+
+    int shift = (bucket >> BENCH_LATENCY_SUB_BITS) - 1;
+    uint64_t step = (uint64_t)(bucket & ((1 << BENCH_LATENCY_SUB_BITS) - 1));
+    return (((1ULL << BENCH_LATENCY_SUB_BITS) + step + 1) << shift) - 1;
+}
+
+static uint64_t benchPercentile(const uint64_t* histogram, uint64_t samples, double fraction) {
+    uint64_t target = (uint64_t)(fraction * (double)samples);
+    uint64_t seen = 0;
+
+    for(int bucket = 0; bucket < BENCH_LATENCY_BUCKETS; bucket++) {
+        seen += histogram[bucket];
+        if(seen > target) {
+            return benchBucketLimit(bucket);
+        }
+    }
+    return 0;
+}
+
+/* Stands in for a slow backing store: spins for costUs and counts calls. */
+static char* benchLoad(int key, size_t* length, long* ttlMs, void* context) {
+    BenchLoader* loader = (BenchLoader*)context;
+    int64_t until = cacheNowNanos() + loader->costUs * 1000;
+
+    (void)key;
+    (void)ttlMs;
+    __atomic_fetch_add(&loader->calls, 1, __ATOMIC_RELAXED);
+    while(cacheNowNanos() < until) {
+    }
+
+    char* value = (char*)malloc(loader->valueLength + 1);
+    if(value) {
+        memcpy(value, loader->value, loader->valueLength + 1);
+        *length = loader->valueLength;
+    }
+    return value;
+}
+
+/* Batched cache-aside replay: one shardedMultiGet per batchSize operations,
+   then one shardedMultiPut for its misses. Worker i takes batches i,
+   i + threads, ... and every operation in a batch is charged the batch's mean
+   latency. A key repeated within a batch misses each time, so the hit ratio
+   can sit slightly below the per-key replay's. */
+static void runBenchBatches(BenchWorker* worker) {
+    ValueHandle results[BENCH_MAX_BATCH];
+    BatchPut misses[BENCH_MAX_BATCH];
+    size_t batchSize = (size_t)worker->batchSize;
+
+    for(size_t first = (size_t)worker->threadIndex * batchSize; first < worker->keyCount;
+        first += batchSize * (size_t)worker->threads) {
+        const int* keys = worker->keys + first;
+        size_t count = worker->keyCount - first < batchSize ? worker->keyCount - first : batchSize;
+        size_t missCount = 0;
+        int64_t started = cacheNowNanos();
+
+        shardedMultiGet(worker->cache, keys, count, results);
+        for(size_t keyIndex = 0; keyIndex < count; keyIndex++) {
+            if(results[keyIndex].length >= 0) {
+                releaseValue(&results[keyIndex]);
+                continue;
+            }
+            misses[missCount].key = keys[keyIndex];
+            misses[missCount].value = worker->value;
+            misses[missCount].length = worker->valueLength;
+            misses[missCount].ttlMs = TTL_DEFAULT;
+            missCount++;
+        }
+        shardedMultiPut(worker->cache, misses, missCount);
+
+        worker->hits += count - missCount;
+        worker->misses += missCount;
+        worker->latency[benchLatencyBucket((uint64_t)(cacheNowNanos() - started) / count)] += count;
+    }
+}
+
+/* Cache-aside replay: get, and put the value on a miss, or go through
+   getOrLoad when a loader is set, in which case only real loader calls
+   count as misses. Worker i takes operations i, i + threads, ... so trace
+   order is kept across threads. */
+static void* runBenchWorker(void* argument) {
+    BenchWorker* worker = (BenchWorker*)argument;
+    ValueHandle value;
+
+    pthread_barrier_wait(worker->start);
+    if(worker->batchSize > 0) {
+        runBenchBatches(worker);
+        return NULL;
+    }
+    for(size_t operation = (size_t)worker->threadIndex; operation < worker->keyCount;
+        operation += (size_t)worker->threads) {
+        int key = worker->keys[operation];
+        int64_t started = cacheNowNanos();
+
+        if(worker->loader) {
+            getOrLoad(worker->cache, key, benchLoad, worker->loader, &value);
+            releaseValue(&value);
+            worker->hits++;
+        } else if(shardedGetValue(worker->cache, key, &value) >= 0) {
+            worker->hits++;
+            releaseValue(&value);
+        } else {
+            worker->misses++;
+            shardedPutValue(worker->cache, key, worker->value, worker->valueLength, TTL_DEFAULT);
+        }
+        worker->latency[benchLatencyBucket((uint64_t)(cacheNowNanos() - started))]++;
+    }
+    return NULL;
+}
+
+static int runBenchCase(const BenchConfig* config, const int* keys, size_t keyCount, const char* value,
+                        EvictionPolicy policy, int capacity, int batchSize) {
+    CacheConfig cacheConfig = { .capacity = capacity, .shardCount = config->shardCount, .policy = policy };
+    ShardedCache* cache = createShardedCache(&cacheConfig);
+    BenchWorker* workers = (BenchWorker*)calloc((size_t)config->threads, sizeof(BenchWorker));
+    pthread_t* threads = (pthread_t*)calloc((size_t)config->threads, sizeof(pthread_t));
+    if(!cache || !workers || !threads) {
+        printf("Memory allocation failed\n");
+        freeShardedCache(cache);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    BenchLoader loader = { value, config->valueSize, config->loadCostUs, 0 };
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)config->threads + 1);
+
+    int started = 0;
+    for(; started < config->threads; started++) {
+        BenchWorker* worker = &workers[started];
+        worker->cache = cache;
+        worker->loader = config->loadCostUs > 0 ? &loader : NULL;
+        worker->keys = keys;
+        worker->keyCount = keyCount;
+        worker->threadIndex = started;
+        worker->threads = config->threads;
+        worker->value = value;
+        worker->valueLength = config->valueSize;
+        worker->batchSize = batchSize;
+        worker->start = &start;
+        if(pthread_create(&threads[started], NULL, runBenchWorker, worker) != 0) {
+            break;
+        }
+    }
+    if(started < config->threads) {
+        printf("Could not start benchmark threads\n");
+        exit(1);
+    }
+
+    pthread_barrier_wait(&start);
+    int64_t begin = cacheNowNanos();
+    for(int threadIndex = 0; threadIndex < config->threads; threadIndex++) {
+        pthread_join(threads[threadIndex], NULL);
+    }
+    double seconds = (double)(cacheNowNanos() - begin) / 1e9;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t latency[BENCH_LATENCY_BUCKETS] = { 0 };
+    for(int threadIndex = 0; threadIndex < config->threads; threadIndex++) {
+        hits += workers[threadIndex].hits;
+        misses += workers[threadIndex].misses;
+        for(int bucket = 0; bucket < BENCH_LATENCY_BUCKETS; bucket++) {
+            latency[bucket] += workers[threadIndex].latency[bucket];
+        }
+    }
+
+    if(config->loadCostUs > 0) {
+        misses = loader.calls < hits ? loader.calls : hits;
+        hits -= misses;
+    }
+    uint64_t operations = hits + misses;
+    printf("%-8s %10d %12.0f %9.2f%% %9llu %9llu %9llu", policyNames[policy], capacity,
+           seconds > 0 ? operations / seconds : 0.0, operations ? 100.0 * hits / operations : 0.0,
+           (unsigned long long)benchPercentile(latency, operations, 0.5),
+           (unsigned long long)benchPercentile(latency, operations, 0.99),
+           (unsigned long long)benchPercentile(latency, operations, 0.999));
+    if(config->loadCostUs > 0) {
+        printf(" %9llu", (unsigned long long)loader.calls);
+    }
+    if(config->batchSize > 0) {
+        printf(" %9d", batchSize > 0 ? batchSize : 1);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    pthread_barrier_destroy(&start);
+    free(threads);
+    free(workers);
+    freeShardedCache(cache);
+    return 1;
+}
+
+static int parseBenchOption(BenchConfig* config, const char* option) {
+    if(strncmp(option, "workload=", 9) == 0) {
+        for(int workload = 0; workload <= WORKLOAD_TRACE; workload++) {
+            if(strcasecmp(option + 9, workloadNames[workload]) == 0) {
+                config->workload = (BenchWorkload)workload;
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if(strncmp(option, "trace=", 6) == 0) {
+        config->tracePath = option + 6;
+        config->workload = WORKLOAD_TRACE;
+        return 1;
+    }
+    if(strncmp(option, "keys=", 5) == 0) {
+        config->keyCount = atoi(option + 5);
+        return config->keyCount > 0;
+    }
+    if(strncmp(option, "ops=", 4) == 0) {
+        config->operations = atol(option + 4);
+        return config->operations > 0;
+    }
+    if(strncmp(option, "threads=", 8) == 0) {
+        config->threads = atoi(option + 8);
+        return config->threads > 0;
+    }
+    if(strncmp(option, "shards=", 7) == 0) {
+        config->shardCount = atoi(option + 7);
+        return config->shardCount > 0;
+    }
+    if(strncmp(option, "theta=", 6) == 0) {
+        config->zipfTheta = atof(option + 6);
+        return config->zipfTheta >= 0;
+    }
+    if(strncmp(option, "scan=", 5) == 0) {
+        config->scanLength = atoi(option + 5);
+        return config->scanLength > 0;
+    }
+    if(strncmp(option, "value=", 6) == 0) {
+        return parseByteSize(option + 6, &config->valueSize);
+    }
+    if(strncmp(option, "loadCost=", 9) == 0) {
+        config->loadCostUs = atol(option + 9);
+        return config->loadCostUs >= 0;
+    }
+    if(strncmp(option, "batch=", 6) == 0) {
+        config->batchSize = atoi(option + 6);
+        return config->batchSize > 0 && config->batchSize <= BENCH_MAX_BATCH;
+    }
+    if(strncmp(option, "seed=", 5) == 0) {
+        config->seed = strtoull(option + 5, NULL, 10);
+        return 1;
+    }
+    if(strncmp(option, "capacity=", 9) == 0) {
+        config->capacityCount = 0;
+        for(const char* cursor = option + 9; *cursor && config->capacityCount < BENCH_MAX_CAPACITIES;) {
+            char* end = NULL;
+            long capacity = strtol(cursor, &end, 10);
+            if(end == cursor || capacity <= 0) {
+                return 0;
+            }
+            config->capacities[config->capacityCount++] = (int)capacity;
+            cursor = *end == ',' ? end + 1 : end;
+        }
+        return config->capacityCount > 0;
+    }
+    if(strncmp(option, "policy=", 7) == 0) {
+        char names[64];
+        snprintf(names, sizeof(names), "%s", option + 7);
+        config->policyCount = 0;
+        if(strcasecmp(names, "all") == 0) {
+            for(int policy = 0; policy <= POLICY_TINYLFU; policy++) {
+                config->policies[config->policyCount++] = (EvictionPolicy)policy;
+            }
+            return 1;
+        }
+        for(char* name = strtok(names, ","); name && config->policyCount <= POLICY_TINYLFU;
+            name = strtok(NULL, ",")) {
+            if(!parsePolicy(name, &config->policies[config->policyCount++])) {
+                return 0;
+            }
+        }
+        return config->policyCount > 0;
+    }
+    return 0;
+}
+
+int runBench(int argc, char** argv) {
+    BenchConfig config = { WORKLOAD_ZIPF, NULL, 100000, 1000000, 1, 16, 0.99, 10000, 32, 0, 1,
+                           { 1000, 10000 }, 2, { POLICY_LRU }, 1, 0 };
+
+    for(int argIndex = 0; argIndex < argc; argIndex++) {
+        if(!parseBenchOption(&config, argv[argIndex])) {
+            printf("Invalid option %s\n", argv[argIndex]);
+            return 1;
+        }
+    }
+    if(config.workload == WORKLOAD_TRACE && !config.tracePath) {
+        printf("Trace workload needs trace=<file>\n");
+        return 1;
+    }
+    if(config.batchSize > 0 && config.loadCostUs > 0) {
+        printf("batch= cannot be combined with loadCost=\n");
+        return 1;
+    }
+
+    size_t keyCount = 0;
+    int* keys = generateKeys(&config, &keyCount);
+    char* value = (char*)malloc(config.valueSize + 1);
+    if(!keys || !value) {
+        free(keys);
+        free(value);
+        return 1;
+    }
+    memset(value, 'v', config.valueSize);
+    value[config.valueSize] = '\0';
+
+    if(config.workload == WORKLOAD_TRACE) {
+        printf("workload=trace trace=%s", config.tracePath);
+    } else {
+        printf("workload=%s keys=%d", workloadNames[config.workload], config.keyCount);
+    }
+    printf(" ops=%zu threads=%d shards=%d value=%zu\n", keyCount, config.threads, config.shardCount,
+           config.valueSize);
+    printf("%-8s %10s %12s %10s %9s %9s %9s%s", "policy", "capacity", "ops/sec", "hitRatio", "p50(ns)",
+           "p99(ns)", "p999(ns)", config.loadCostUs > 0 ? "     loads" : "");
+    if(config.batchSize > 0) {
+        printf("%s", "     batch");
+    }
+    printf("\n");
+    for(int policyIndex = 0; policyIndex < config.policyCount; policyIndex++) {
+        for(int capacityIndex = 0; capacityIndex < config.capacityCount; capacityIndex++) {
+            runBenchCase(&config, keys, keyCount, value, config.policies[policyIndex],
+                         config.capacities[capacityIndex], 0);
+            if(config.batchSize > 0) {
+                runBenchCase(&config, keys, keyCount, value, config.policies[policyIndex],
+                             config.capacities[capacityIndex], config.batchSize);
+            }
+        }
+    }
+
+    free(keys);
+    free(value);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return runServer(argc - 2, argv + 2);
+    }
+    if(argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return runBench(argc - 2, argv + 2);
+    }
+
+    char line[256];
+    char command[50];
+    ShardedCache* cache = NULL;
+
+    while(fgets(line, sizeof(line), stdin)) {
+        if(sscanf(line, "%49s", command) != 1) {
+            continue;
+        }
+
+        if(strcmp(command, "createCache") == 0) {
+            CacheConfig config = { .capacity = 0, .shardCount = 1, .policy = POLICY_LRU };
+            int valid = 1;
+            strtok(line, " \t\r\n");
+            char* token = strtok(NULL, " \t\r\n");
+
+            if(token) {
+                char* end = NULL;
+                long capacity = strtol(token, &end, 10);
+                if(end != token && *end == '\0') {
+                    config.capacity = capacity > 0 && capacity <= INT_MAX ? (int)capacity : -1;
+                    token = strtok(NULL, " \t\r\n");
+                }
+            }
+            for(; token; token = strtok(NULL, " \t\r\n")) {
+                if(!parseCacheOption(&config, token)) {
+                    printf("Invalid option %s\n", token);
+                    valid = 0;
+                }
+            }
+            if(valid && (config.capacity < 0 || (config.capacity == 0 && config.maxBytes == 0))) {
+                printf("createCache needs a capacity or bytes=<size>\n");
+                valid = 0;
+            }
+
+            if(valid) {
+                freeShardedCache(cache);
+                cache = createShardedCache(&config);
+            }
+        } else if(strcmp(command, "put") == 0 && cache) {
+            int key;
+            long ttlMs = TTL_DEFAULT;
+            char value[100];
+            if(sscanf(line, "%*s %d %99s %ld", &key, value, &ttlMs) >= 2) {
+                shardedPutValue(cache, key, value, strlen(value), ttlMs);
+            }
+        } else if(strcmp(command, "get") == 0 && cache) {
+            int key;
+            char value[100];
+            if(sscanf(line, "%*s %d", &key) == 1 && shardedGet(cache, key, value, sizeof(value)) >= 0) {
+                printf("%s\n", value);
+            } else {
+                printf("NULL\n");
+            }
+        } else if(strcmp(command, "mget") == 0 && cache) {
+            int keys[64];
+            ValueHandle results[64];
+            size_t count = 0;
+
+            strtok(line, " \t\r\n");
+            for(char* token = strtok(NULL, " \t\r\n"); token && count < 64; token = strtok(NULL, " \t\r\n")) {
+                keys[count++] = atoi(token);
+            }
+
+            shardedMultiGet(cache, keys, count, results);
+            for(size_t keyIndex = 0; keyIndex < count; keyIndex++) {
+                printf("%s\n", results[keyIndex].length >= 0 ? valueData(&results[keyIndex]) : "NULL");
+                releaseValue(&results[keyIndex]);
+            }
+        } else if(strcmp(command, "mput") == 0 && cache) {
+            BatchPut entries[32];
+            size_t count = 0;
+
+            strtok(line, " \t\r\n");
+            char* keyToken = strtok(NULL, " \t\r\n");
+            char* valueToken = strtok(NULL, " \t\r\n");
+            while(keyToken && valueToken && count < 32) {
+                entries[count].key = atoi(keyToken);
+                entries[count].value = valueToken;
+                entries[count].length = strlen(valueToken);
+                entries[count].ttlMs = TTL_DEFAULT;
+                count++;
+                keyToken = strtok(NULL, " \t\r\n");
+                valueToken = strtok(NULL, " \t\r\n");
+            }
+
+            shardedMultiPut(cache, entries, count);
+        } else if(strcmp(command, "snapshot") == 0 && cache) {
+            char path[200];
+            if(sscanf(line, "%*s %199s", path) == 1) {
+                long saved = saveSnapshot(cache, path);
+                if(saved >= 0) {
+                    printf("Saved %ld entries\n", saved);
+                }
+            }
+        } else if(strcmp(command, "restore") == 0 && cache) {
+            char path[200];
+            if(sscanf(line, "%*s %199s", path) == 1) {
+                long restored = loadSnapshot(cache, path);
+                if(restored >= 0) {
+                    printf("Restored %ld entries\n", restored);
+                }
             }
+        } else if(strcmp(command, "stats") == 0 && cache) {
+            printCacheStats(cache);
         } else if(strcmp(command, "exit") == 0) {
-            freeCache(cache);
             break;
         }
     }
 
+    freeShardedCache(cache);
     return 0;
 }